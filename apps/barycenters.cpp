@@ -163,9 +163,9 @@ int main(int argc, char** argv)
   }
 
   std::vector<TransportMap> tmaps;
-  std::vector<MatrixXd> input_densities;
+  std::vector<MatrixXd> filtered_densities;
   generate_transport_maps(opts.inputs, tmaps, opts,
-    [&opts,&input_densities](MatrixXd& img) {
+    [&opts,&filtered_densities](MatrixXd& img) {
       if(opts.use_inv)
         img = 1.-img.array();
       
@@ -177,17 +177,29 @@ int main(int argc, char** argv)
         img.swap(tmp);
       }
 
-      input_densities.push_back(img);
+      filtered_densities.push_back(img);
     });
 
+  // the filter is not applied to .tmap inputs, whose stored density is already the final one
+  std::vector<MatrixXd> input_densities;
+  for(size_t k=0, j=0; k<tmaps.size(); ++k)
+  {
+    if(is_transport_map_file(opts.inputs[k]))
+    {
+      int n = std::lround(std::sqrt(double(tmaps[k].density().size())));
+      input_densities.push_back(Map<const MatrixXd>(tmaps[k].density().data(), n, n));
+    }
+    else
+      input_densities.push_back(filtered_densities[j++]);
+  }
+
   std::vector<Surface_mesh> inv_maps(tmaps.size());
   int img_res = input_densities[0].rows();
   std::cout << "Generate inverse maps...\n";
   std::vector<double> density_means(tmaps.size());
   for(int k=0; k<tmaps.size(); ++k)
   {
-    inv_maps[k] = tmaps[k].origin_mesh();
-    apply_inverse_map(tmaps[k], inv_maps[k].points(), opts.verbose_level);
+    compute_inverse_mesh(tmaps[k], inv_maps[k], opts.verbose_level);
     density_means[k] = input_densities[k].mean();
 
     if(opts.export_maps) {
@@ -253,13 +265,11 @@ void interpolate(const std::vector<Surface_mesh> &inv_maps, double alpha, double
   result.clear();
   result = inv_maps[0];
 
-  int nv = result.vertices_size();
-
-  for(int j=0; j<nv; ++j){
-    Surface_mesh::Vertex v(j);
-    // bilinear interpolation
-    result.position(v) = bilerp(alpha,beta,inv_maps[0].position(v),inv_maps[1].position(v),inv_maps[2].position(v),inv_maps[3].position(v));
-  }
+  // bilinear interpolation of all the vertices at once, as bilerp() does per vertex
+  result.points_matrix() = (1.-alpha)*(1.-beta)*inv_maps[0].points_matrix()
+                         + (   alpha)*(1.-beta)*inv_maps[1].points_matrix()
+                         + (   alpha)*(   beta)*inv_maps[2].points_matrix()
+                         + (1.-alpha)*(   beta)*inv_maps[3].points_matrix();
 }
 
 void interpolate(const std::vector<Surface_mesh> &inv_maps, double alpha, Surface_mesh& result)
@@ -268,23 +278,18 @@ void interpolate(const std::vector<Surface_mesh> &inv_maps, double alpha, Surfac
   result.clear();
   result = inv_maps[0];
 
-  int nv = result.vertices_size();
-
-  for(int j=0; j<nv; ++j){
-    Surface_mesh::Vertex v(j);
-    // linear interpolation
-    result.position(v) = lerp(alpha,inv_maps[0].position(v),inv_maps[1].position(v));
-  }
+  // linear interpolation of all the vertices at once, as lerp() does per vertex
+  result.points_matrix() = (1.-alpha)*inv_maps[0].points_matrix() + alpha*inv_maps[1].points_matrix();
 }
 
 void synthetize_and_save_image(const Surface_mesh& map, const std::string& filename, int res, double expected_mean, bool inv)
 {
-  MatrixXd img(res,res);
+  MatrixXf img(res,res);
   rasterize_image(map, img);
-  img = img * (expected_mean/img.mean());
+  img *= float(expected_mean/img.mean());
 
   if(inv)
-    img = 1.-img.array();
+    img = 1.f-img.array();
 
   save_image(filename.c_str(), img);
 }
@@ -127,35 +127,24 @@ struct CLIopts : CLI_OTSolverOptions
   }
 };
 
-template<typename T,typename S>
-T lerp(S u, const T& a0, const T& a1)
-{
-  return (1.-u)*a0 + u*a1;
-}
-
 void interpolate(const std::vector<Surface_mesh> &inv_maps, double alpha, Surface_mesh& result)
 {
   //clear output
   result.clear();
   result = inv_maps[0];
 
-  int nv = result.vertices_size();
-
-  for(int j=0; j<nv; ++j){
-    Surface_mesh::Vertex v(j);
-    // linear interpolation
-    result.position(v) = lerp(alpha,inv_maps[0].position(v),inv_maps[1].position(v));
-  }
+  // linear interpolation of all the vertices at once
+  result.points_matrix() = (1.-alpha)*inv_maps[0].points_matrix() + alpha*inv_maps[1].points_matrix();
 }
 
 void synthetize_and_save_image(const Surface_mesh& map, const std::string& filename, int res, double expected_mean, bool inv)
 {
-  MatrixXd img(res,res);
+  MatrixXf img(res,res);
   rasterize_image(map, img);
-  img = img * (expected_mean/img.mean());
+  img *= float(expected_mean/img.mean());
 
   if(inv)
-    img = 1.-img.array();
+    img = 1.f-img.array();
 
   save_image(filename.c_str(), img);
 }
@@ -403,19 +392,9 @@ TransportMap runOptimalTransport(MatrixXd &density, CLIopts &opts) {
   return tmap_src;
 }
 
-void applyTransportMapping(TransportMap &tmap_src, TransportMap &tmap_trg, MatrixXd &density_trg, std::vector<Eigen::Vector2d> &vertex_positions) {
-  Surface_mesh map_uv = tmap_src.fwd_mesh();
-  Surface_mesh map_orig = tmap_src.origin_mesh();
-
-  apply_inverse_map(tmap_trg, map_uv.points(), 3);
-
-  auto originMeshPtr = std::make_shared<surface_mesh::Surface_mesh>(map_uv);
-  auto fwdMeshPtr = std::make_shared<surface_mesh::Surface_mesh>(map_orig);
-  auto densityPtr = std::make_shared<Eigen::VectorXd>(density_trg);
-
-  TransportMap transport(originMeshPtr, fwdMeshPtr, densityPtr);
-  
-  apply_inverse_map(transport, vertex_positions, 3);
+void applyTransportMapping(TransportMap &tmap_src, TransportMap &tmap_trg, std::vector<Eigen::Vector2d> &vertex_positions) {
+  // x -> tmap_trg.inv(tmap_src.fwd(x))
+  ComposedTransportMap(tmap_src, tmap_trg).apply(vertex_positions, 3);
 }
 
 std::vector<double> cross(std::vector<double> v1, std::vector<double> v2){
@@ -681,13 +660,13 @@ int main(int argc, char** argv)
     return EXIT_FAILURE;
   }
 
-  if(!load_input_density(opts.filename_src, density_src))
+  if(!load_input_density(opts.filename_src, density_src, opts.input_res))
   {
     std::cout << "Failed to load input \"" << opts.filename_src << "\" -> abort.";
     exit(EXIT_FAILURE);
   }
     
-  if(!load_input_density(opts.filename_trg, density_trg))
+  if(!load_input_density(opts.filename_trg, density_trg, opts.input_res))
   {
     std::cout << "Failed to load input \"" << opts.filename_trg << "\" -> abort.";
     exit(EXIT_FAILURE);
@@ -714,7 +693,7 @@ int main(int argc, char** argv)
     vertex_positions.push_back(point);
   }
 
-  applyTransportMapping(tmap_src, tmap_trg, density_trg, vertex_positions);
+  applyTransportMapping(tmap_src, tmap_trg, vertex_positions);
   
   std::vector<std::vector<double>> trg_pts;
   for (int i=0; i<mesh.source_points.size(); i++)
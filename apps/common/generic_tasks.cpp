@@ -17,7 +17,7 @@ using namespace Eigen;
 using namespace surface_mesh;
 using namespace otmap;
 
-bool load_input_density(const std::string& filename, MatrixXd& density)
+bool load_input_density(const std::string& filename, MatrixXd& density, int max_res)
 {
   if(filename[0]==':')
   {
@@ -34,7 +34,7 @@ bool load_input_density(const std::string& filename, MatrixXd& density)
   }
   else
   {
-    load_image(filename.c_str(), density);
+    load_image(filename.c_str(), density, max_res);
     if(density.size()==0)
       return false;
     if(density.rows()!=density.cols())
@@ -46,6 +46,11 @@ bool load_input_density(const std::string& filename, MatrixXd& density)
   return true;
 }
 
+bool is_transport_map_file(const std::string& filename)
+{
+  return filename.size()>5 && filename.substr(filename.size()-5)==".tmap";
+}
+
 void generate_transport_maps(const std::vector<std::string>& inputs, std::vector<TransportMap>& tmaps, const CLI_OTSolverOptions& opts,
                             std::function<void(Eigen::MatrixXd&)> filter)
 {
@@ -56,8 +61,21 @@ void generate_transport_maps(const std::vector<std::string>& inputs, std::vector
     std::cout << "Generate all transport maps...\n";
   for(int k=0; k<inputs.size(); ++k)
   {
+    if(is_transport_map_file(inputs[k]))
+    {
+      // previously computed map, its stored density is final and is not filtered again
+      std::shared_ptr<TransportMap> tmap = read_transport_map(inputs[k]);
+      if(tmap==nullptr)
+      {
+        std::cout << "Failed to load map #" << k << " \"" << inputs[k] << "\" -> abort.";
+        exit(EXIT_FAILURE);
+      }
+      tmaps.push_back(*tmap);
+      continue;
+    }
+
     MatrixXd density;
-    if(!load_input_density(inputs[k], density))
+    if(!load_input_density(inputs[k], density, opts.input_res))
     {
       std::cout << "Failed to load input #" << k << " \"" << inputs[k] << "\" -> abort.";
       exit(EXIT_FAILURE);
@@ -66,19 +84,44 @@ void generate_transport_maps(const std::vector<std::string>& inputs, std::vector
     filter(density);
     tmaps.push_back( otsolver.solve(vec(density), opts.solver_opt) );
   }
+
+  if(opts.upsample_res>0)
+  {
+    for(size_t k=0; k<tmaps.size(); ++k)
+    {
+      if(tmaps[k].grid_size()>=opts.upsample_res)
+        continue;
+      if(opts.verbose_level>=1)
+        std::cout << "Upsample map #" << k << " from " << tmaps[k].grid_size() << "^2 to " << opts.upsample_res << "^2\n";
+      tmaps[k] = upsample_transport_map(tmaps[k], opts.upsample_res);
+      if(opts.upsample_iter>0)
+      {
+        SolverOptions solver_opt = opts.solver_opt;
+        solver_opt.max_iter = opts.upsample_iter;
+        otsolver.init(opts.upsample_res);
+        tmaps[k] = otsolver.solve(tmaps[k].density(), tmaps[k].potential(), solver_opt);
+      }
+    }
+  }
 }
 
-void synthetize_and_export_image(const Surface_mesh& map, int img_res, const VectorXd& target, const std::string base_filename, const VectorXd& input_density, double gamma)
+static int nb_faces(const Surface_mesh& map) { return map.faces_size(); }
+static int nb_faces(const GridMesh& map) { return map.n_faces(); }
+
+// MapType is either a Surface_mesh or a GridMesh
+template<typename MapType>
+static void synthetize_and_export_image_impl(const MapType& map, int img_res, const VectorXd& target, const std::string base_filename, const VectorXd& input_density, double gamma)
 {
- int samples_per_face = 300;
+  // samples are drawn from a low-discrepancy sequence, a few tens per face are enough for a low-noise estimate
+  int samples_per_face = 64;
 
-  MatrixXd img(img_res,img_res);
+  MatrixXf img(img_res,img_res);
   if(input_density.size()>0) {
     VectorXi spf = (samples_per_face*input_density.size()/input_density.sum()*input_density).cast<int>();
-    if(map.faces_size() == 2*spf.size()) {
+    if(nb_faces(map) == 2*spf.size()) {
       // grid represented as triangles, duplicate entries:
-      spf.conservativeResize(map.faces_size());
-      for(int i=map.faces_size()-1; i>=0; i--)
+      spf.conservativeResize(nb_faces(map));
+      for(int i=nb_faces(map)-1; i>=0; i--)
         spf(i) = spf(i/2);
     }
     sample_transportmap_to_image(map, spf, img);
@@ -86,14 +129,40 @@ void synthetize_and_export_image(const Surface_mesh& map, int img_res, const Vec
     sample_transportmap_to_image(map, img, samples_per_face);
   }
 
-  double Esource  = /*target.size() == map.faces_size() ? target.sum()*0.5 : */target.sum();
-  double Eimg     = double(samples_per_face * map.faces_size());
+  double Esource  = /*target.size() == nb_faces(map) ? target.sum()*0.5 : */target.sum();
+  double Eimg     = double(samples_per_face * nb_faces(map));
 
-  img = img * Esource/Eimg ;
+  img *= float(Esource/Eimg);
 
-  save_image(std::string(base_filename).append("_sampling.bmp").c_str(), img.array().pow(gamma));
+  save_image(std::string(base_filename).append("_sampling.bmp").c_str(), img.array().pow(float(gamma)));
 
   rasterize_image(map, img);
-  img = img * target.sum() / target.size();
-  save_image(std::string(base_filename).append("_raster.bmp").c_str(), img.array().pow(gamma));
+  img *= float(target.sum() / target.size());
+  save_image(std::string(base_filename).append("_raster.bmp").c_str(), img.array().pow(float(gamma)));
+
+  // noise-free reconstruction of the pushed-forward mass
+  VectorXd face_mass = VectorXd::Ones(nb_faces(map));
+  if(input_density.size()>0) {
+    face_mass = input_density;
+    if(nb_faces(map) == 2*face_mass.size()) {
+      // grid represented as triangles, split entries:
+      face_mass.conservativeResize(nb_faces(map));
+      for(int i=nb_faces(map)-1; i>=0; i--)
+        face_mass(i) = 0.5*face_mass(i/2);
+    }
+    face_mass *= face_mass.size()/face_mass.sum();
+  }
+  rasterize_image(map, face_mass, img, RIO_PerFaceDensityCoverage);
+  img *= float(target.sum() / target.size());
+  save_image(std::string(base_filename).append("_coverage.bmp").c_str(), img.array().pow(float(gamma)));
+}
+
+void synthetize_and_export_image(const Surface_mesh& map, int img_res, const VectorXd& target, const std::string base_filename, const VectorXd& input_density, double gamma)
+{
+  synthetize_and_export_image_impl(map, img_res, target, base_filename, input_density, gamma);
+}
+
+void synthetize_and_export_image(const GridMesh& map, int img_res, const VectorXd& target, const std::string base_filename, const VectorXd& input_density, double gamma)
+{
+  synthetize_and_export_image_impl(map, img_res, target, base_filename, input_density, gamma);
 }
@@ -16,10 +16,19 @@
 #include "otsolver_options.h"
 #include "transport_map.h"
 
-bool load_input_density(const std::string& filename, Eigen::MatrixXd& density);
+/** Loads the density of an image file, or of a procedural density function ":id:resolution:".
+  * Images larger than \a max_res x \a max_res are area-averaged to that resolution if \a max_res>0. */
+bool load_input_density(const std::string& filename, Eigen::MatrixXd& density, int max_res = 0);
 
+/** \returns whether \a filename is a transport map saved by write_transport_map, i.e., a .tmap file */
+bool is_transport_map_file(const std::string& filename);
+
+/** Solves for the transport map of each input density, or reads it if the input is a .tmap file.
+  * \a filter is called on each input density before solving. It is not called for .tmap inputs,
+  * whose stored density is the final one the map was solved for. */
 void generate_transport_maps(const std::vector<std::string>& inputs, std::vector<otmap::TransportMap>& tmaps, const CLI_OTSolverOptions& opts,
                              std::function<void(Eigen::MatrixXd&)> filter = [](Eigen::MatrixXd&){});
 
 void synthetize_and_export_image(const surface_mesh::Surface_mesh& map, int img_res, const Eigen::VectorXd& target, const std::string base_filename, const Eigen::VectorXd& input_density = Eigen::VectorXd(0), double gamma = 1);
+void synthetize_and_export_image(const otmap::GridMesh& map, int img_res, const Eigen::VectorXd& target, const std::string base_filename, const Eigen::VectorXd& input_density = Eigen::VectorXd(0), double gamma = 1);
 
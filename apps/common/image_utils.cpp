@@ -13,51 +13,301 @@
 #include <iomanip>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <memory>
+#include <csetjmp>
 
 #include <CImg/CImg.h>
 
 using namespace Eigen;
 using namespace surface_mesh;
 
-void load_image(const char* filename, MatrixXd &data)
+namespace {
+
+// Area averaging of a w x h image to out_w x out_h pixels (with out_w<=w and out_h<=h),
+// fed row by row. The result is stored as data(x,y).
+class ImageDownsampler
+{
+public:
+  ImageDownsampler(int w, int h, int out_w, int out_h, MatrixXd& data)
+    : m_data(data), m_row(out_w)
+  {
+    init_axis(w, out_w, m_xw);
+    init_axis(h, out_h, m_yw);
+    m_data.setZero(out_w, out_h);
+  }
+
+  // accumulates the w values of the row y
+  void add_row(int y, const double* values)
+  {
+    m_row.setZero();
+    for(int x=0; x<int(m_xw.size()); ++x)
+    {
+      const Weight& wx = m_xw[x];
+      m_row(wx.o) += wx.w0*values[x];
+      if(wx.w1>0)
+        m_row(wx.o+1) += wx.w1*values[x];
+    }
+    const Weight& wy = m_yw[y];
+    m_data.col(wy.o) += wy.w0*m_row;
+    if(wy.w1>0)
+      m_data.col(wy.o+1) += wy.w1*m_row;
+  }
+
+private:
+  // the source pixel k covers [k*s,(k+1)*s) in target pixels, with s<=1,
+  // its weight is w0 for the target pixel o and w1 for o+1
+  struct Weight { int o; double w0, w1; };
+
+  static void init_axis(int n, int out_n, std::vector<Weight>& weights)
+  {
+    double s = double(out_n)/double(n);
+    weights.resize(n);
+    for(int k=0; k<n; ++k)
+    {
+      double a = k*s, b = (k+1)*s;
+      int o = std::min(int(a), out_n-1);
+      double split = std::min(b, double(o+1));
+      weights[k].o = o;
+      weights[k].w0 = split-a;
+      weights[k].w1 = o+1<out_n ? std::max(0., b-split) : 0.;
+    }
+  }
+
+  MatrixXd& m_data;
+  VectorXd m_row;
+  std::vector<Weight> m_xw, m_yw;
+};
+
+// size of a w x h image downsampled to at most max_res x max_res pixels, keeping its aspect ratio
+void target_size(int w, int h, int max_res, int& out_w, int& out_h)
+{
+  out_w = w;
+  out_h = h;
+  if(max_res>0 && std::max(w,h)>max_res)
+  {
+    double s = double(max_res)/double(std::max(w,h));
+    out_w = std::max(1, int(std::lround(w*s)));
+    out_h = std::max(1, int(std::lround(h*s)));
+  }
+}
+
+#if defined(cimg_use_png) || defined(cimg_use_jpeg)
+bool has_extension(const char* filename, const char* ext)
 {
-  cimg_library::CImg<double> img(filename);
+  std::string name(filename);
+  std::string e(ext);
+  if(name.size()<e.size())
+    return false;
+  name = name.substr(name.size()-e.size());
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  return name==e;
+}
+#endif
+
+#ifdef cimg_use_png
+// Decodes the PNG file row by row, returns false if it fails or if the image is interlaced.
+// Only the first channel is kept, as for the other formats.
+bool load_png_rows(const char* filename, int max_res, MatrixXd& data)
+{
+  FILE* file = fopen(filename, "rb");
+  if(!file)
+    return false;
+  png_byte signature[8];
+  png_structp png = 0;
+  png_infop info = 0;
+  if(fread(signature, 1, 8, file)!=8 || png_sig_cmp(signature, 0, 8)
+     || !(png = png_create_read_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0))
+     || !(info = png_create_info_struct(png)))
+  {
+    png_destroy_read_struct(png ? &png : 0, 0, 0);
+    fclose(file);
+    return false;
+  }
 
-  if(img.is_empty())
+  std::vector<png_byte> row;
+  std::vector<double> values;
+  std::unique_ptr<ImageDownsampler> sampler;
+  if(setjmp(png_jmpbuf(png)))
   {
-    std::cerr << "ERROR image \"" << filename << "\" not found or empty\n";
-    data.resize(0,0);
-    return;
+    png_destroy_read_struct(&png, &info, 0);
+    fclose(file);
+    return false;
+  }
+
+  png_init_io(png, file);
+  png_set_sig_bytes(png, 8);
+  png_read_info(png, info);
+  if(png_get_interlace_type(png, info)!=PNG_INTERLACE_NONE)
+  {
+    png_destroy_read_struct(&png, &info, 0);
+    fclose(file);
+    return false;
+  }
+  png_byte color_type = png_get_color_type(png, info);
+  if(color_type==PNG_COLOR_TYPE_PALETTE)
+    png_set_palette_to_rgb(png);
+  if(color_type==PNG_COLOR_TYPE_GRAY && png_get_bit_depth(png, info)<8)
+    png_set_expand_gray_1_2_4_to_8(png);
+  png_read_update_info(png, info);
+
+  int w = png_get_image_width(png, info);
+  int h = png_get_image_height(png, info);
+  int bytes = png_get_bit_depth(png, info)==16 ? 2 : 1;
+  int stride = png_get_channels(png, info)*bytes;
+  int out_w, out_h;
+  target_size(w, h, max_res, out_w, out_h);
+
+  row.resize(png_get_rowbytes(png, info));
+  values.resize(w);
+  sampler.reset(new ImageDownsampler(w, h, out_w, out_h, data));
+  for(int y=0; y<h; ++y)
+  {
+    png_read_row(png, row.data(), 0);
+    for(int x=0; x<w; ++x)
+    {
+      const png_byte* p = row.data() + x*stride;
+      values[x] = bytes==2 ? double((p[0]<<8) | p[1]) : double(p[0]);
+    }
+    sampler->add_row(y, values.data());
   }
 
-  int h = img.height();
-  int w = img.width();
+  png_destroy_read_struct(&png, &info, 0);
+  fclose(file);
+  return true;
+}
+#endif
+
+#ifdef cimg_use_jpeg
+struct JpegErrorManager
+{
+  jpeg_error_mgr pub;
+  jmp_buf jump;
+};
 
-  data.resize(h, w);
+void jpeg_error_exit_jump(j_common_ptr cinfo)
+{
+  longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+}
 
-  for(int j=0; j<w; ++j)
-    for(int i=0; i<h; ++i)
-      if(img.depth()==1)
-        data(i,j) = img(i,j,0,0)/255.f;
-      else
-        data(i,j) = (img(i,j,0,0)*11.0 + img(i,j,0,1) * 16.0 + img(i,j,0,2)*5.0)/(32.*255.);
+// Decodes the JPEG file scanline by scanline, returns false if it fails.
+// When downsampling, libjpeg first reduces the resolution by up to 8 in the DCT domain.
+bool load_jpeg_rows(const char* filename, int max_res, MatrixXd& data)
+{
+  FILE* file = fopen(filename, "rb");
+  if(!file)
+    return false;
+
+  jpeg_decompress_struct cinfo;
+  JpegErrorManager error;
+  cinfo.err = jpeg_std_error(&error.pub);
+  error.pub.error_exit = jpeg_error_exit_jump;
+
+  std::vector<JSAMPLE> row;
+  std::vector<double> values;
+  std::unique_ptr<ImageDownsampler> sampler;
+  if(setjmp(error.jump))
+  {
+    jpeg_destroy_decompress(&cinfo);
+    fclose(file);
+    return false;
+  }
+
+  jpeg_create_decompress(&cinfo);
+  jpeg_stdio_src(&cinfo, file);
+  jpeg_read_header(&cinfo, TRUE);
+
+  int out_w, out_h;
+  target_size(cinfo.image_width, cinfo.image_height, max_res, out_w, out_h);
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = 1;
+  while(cinfo.scale_denom<8 && int(cinfo.image_width/(2*cinfo.scale_denom))>=out_w
+                            && int(cinfo.image_height/(2*cinfo.scale_denom))>=out_h)
+    cinfo.scale_denom *= 2;
+  jpeg_start_decompress(&cinfo);
+
+  int w = cinfo.output_width;
+  int h = cinfo.output_height;
+  int channels = cinfo.output_components;
+  row.resize(w*channels);
+  values.resize(w);
+  sampler.reset(new ImageDownsampler(w, h, out_w, out_h, data));
+  while(int(cinfo.output_scanline)<h)
+  {
+    int y = cinfo.output_scanline;
+    JSAMPROW p = row.data();
+    jpeg_read_scanlines(&cinfo, &p, 1);
+    for(int x=0; x<w; ++x)
+      values[x] = row[x*channels];
+    sampler->add_row(y, values.data());
+  }
+
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  fclose(file);
+  return true;
+}
+#endif
+
+}
+
+void load_image(const char* filename, MatrixXd &data, int max_res)
+{
+  bool loaded = false;
+#ifdef cimg_use_png
+  if(has_extension(filename, ".png"))
+    loaded = load_png_rows(filename, max_res, data);
+#endif
+#ifdef cimg_use_jpeg
+  if(has_extension(filename, ".jpg") || has_extension(filename, ".jpeg"))
+    loaded = load_jpeg_rows(filename, max_res, data);
+#endif
+
+  if(!loaded)
+  {
+    // other formats are decoded at once by CImg
+    cimg_library::CImg<float> img(filename);
+
+    if(img.is_empty())
+    {
+      std::cerr << "ERROR image \"" << filename << "\" not found or empty\n";
+      data.resize(0,0);
+      return;
+    }
+
+    int w = img.width();
+    int h = img.height();
+    int out_w, out_h;
+    target_size(w, h, max_res, out_w, out_h);
+    ImageDownsampler sampler(w, h, out_w, out_h, data);
+    VectorXd values(w);
+    for(int y=0; y<h; ++y)
+    {
+      for(int x=0; x<w; ++x)
+        values(x) = img(x,y,0,0);
+      sampler.add_row(y, values.data());
+    }
+  }
+
+  data /= 255.;
   double maxval = data.maxCoeff();
   if(maxval>1)
     data /= maxval;
 }
 
-void save_image(const char* filename, Ref<const MatrixXd> data)
+template<typename Scalar>
+static void save_image_impl(const char* filename, Ref<const Matrix<Scalar,Dynamic,Dynamic> > data)
 {
   int h = data.cols();
   int w = data.rows();
 
-  cimg_library::CImg<double> temp(w, h, 1, 3, 0);
+  cimg_library::CImg<Scalar> temp(w, h, 1, 3, 0);
 
   for(int i=0; i<w; ++i){
       for(int j=0; j<h; ++j){
 
-        double v = data(i, j)*255.;
-        v = std::max(0., std::min(255., v)); //truncate between 0 and 255
+        Scalar v = data(i, j)*Scalar(255);
+        v = std::max(Scalar(0), std::min(Scalar(255), v)); //truncate between 0 and 255
 
         temp(i, j, 0., 0) = v;
         temp(i, j, 0., 1) = v;
@@ -68,19 +318,41 @@ void save_image(const char* filename, Ref<const MatrixXd> data)
   temp.save(filename);
 }
 
-void save_matrix_as_image(const char* filename, Ref<const MatrixXd> mat, double max)
+void save_image(const char* filename, Ref<const MatrixXd> data)
+{
+  save_image_impl<double>(filename, data);
+}
+
+void save_image(const char* filename, Ref<const MatrixXf> data)
 {
-  MatrixXd tmp = mat;
+  save_image_impl<float>(filename, data);
+}
+
+template<typename Scalar>
+static void save_matrix_as_image_impl(const char* filename, Ref<const Matrix<Scalar,Dynamic,Dynamic> > mat, double max)
+{
+  Matrix<Scalar,Dynamic,Dynamic> tmp = mat;
   if(max<0)
     tmp = (tmp.array() - tmp.minCoeff()) / (tmp.maxCoeff() - tmp.minCoeff());
   else
-    tmp = (tmp.array() / max);
+    tmp = (tmp.array() / Scalar(max));
 
   save_image(filename, tmp);
 }
 
-void
-gaussian_blur(Ref<const MatrixXd> in, Ref<MatrixXd> out, int kernel_size)
+void save_matrix_as_image(const char* filename, Ref<const MatrixXd> mat, double max)
+{
+  save_matrix_as_image_impl<double>(filename, mat, max);
+}
+
+void save_matrix_as_image(const char* filename, Ref<const MatrixXf> mat, double max)
+{
+  save_matrix_as_image_impl<float>(filename, mat, max);
+}
+
+template<typename Scalar>
+static void
+gaussian_blur_impl(Ref<const Matrix<Scalar,Dynamic,Dynamic> > in, Ref<Matrix<Scalar,Dynamic,Dynamic> > out, int kernel_size)
 {
   // mirror border conditions
   auto mirror = [] (int i, int n)
@@ -108,14 +380,15 @@ gaussian_blur(Ref<const MatrixXd> in, Ref<MatrixXd> out, int kernel_size)
     ker(i) = a * exp(-(x*x)/sigma2_sq);
   }
   ker /= ker.sum();
+  Matrix<Scalar,Dynamic,1> sker = ker.cast<Scalar>();
 
-  MatrixXd temp = out;
+  Matrix<Scalar,Dynamic,Dynamic> temp = out;
   // vertical convolution
   for(int j=0; j<in.cols(); ++j){
     for(int i=0; i<in.rows(); ++i){
-      double sum = 0;
-      for(int k=0; k<ker.size(); ++k)
-        sum += in(mirror(i-ker.size()/2 + k,in.rows()), j) * ker(k);
+      Scalar sum = 0;
+      for(int k=0; k<sker.size(); ++k)
+        sum += in(mirror(i-sker.size()/2 + k,in.rows()), j) * sker(k);
       temp(i, j) = sum;
     }
   }
@@ -123,14 +396,26 @@ gaussian_blur(Ref<const MatrixXd> in, Ref<MatrixXd> out, int kernel_size)
   // horizontal convolution
   for(int i=0; i<in.rows(); ++i){
     for(int j=0; j<in.cols(); ++j){
-      double sum = 0;
-      for(int k=0; k<ker.size(); ++k)
-        sum += temp(i, mirror(j - ker.size()/2 + k, in.cols())) * ker(k);
+      Scalar sum = 0;
+      for(int k=0; k<sker.size(); ++k)
+        sum += temp(i, mirror(j - sker.size()/2 + k, in.cols())) * sker(k);
       out(i,j) = sum;
     }
   }
 }
 
+void
+gaussian_blur(Ref<const MatrixXd> in, Ref<MatrixXd> out, int kernel_size)
+{
+  gaussian_blur_impl<double>(in, out, kernel_size);
+}
+
+void
+gaussian_blur(Ref<const MatrixXf> in, Ref<MatrixXf> out, int kernel_size)
+{
+  gaussian_blur_impl<float>(in, out, kernel_size);
+}
+
 void make_unit(std::vector<Vector3d> &pts)
 {
   Eigen::AlignedBox2d aabb;
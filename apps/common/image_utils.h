@@ -19,18 +19,23 @@
 
 // Image IO ----------------
 
-// Load an image as a matrix (colors are converted to gray levels
-void load_image(const char* filename, Eigen::MatrixXd &img);
+// Load the first channel of an image as a matrix img(x,y) of gray levels.
+// If max_res>0, larger images are area-averaged to at most max_res x max_res pixels while being
+// decoded, PNG and JPEG files are decoded row by row without storing the full resolution image.
+void load_image(const char* filename, Eigen::MatrixXd &img, int max_res = 0);
 
 // Save a matrix as a gray level image
 void save_image(const char* filename, Eigen::Ref<const Eigen::MatrixXd> img);
+void save_image(const char* filename, Eigen::Ref<const Eigen::MatrixXf> img);
 
 // Save a matrix as a 2D gray level image normalized to 0-1 (if max<0) or rescaled to max otherwise:
 void save_matrix_as_image(const char* filename, Eigen::Ref<const Eigen::MatrixXd> img, double max=-1.);
+void save_matrix_as_image(const char* filename, Eigen::Ref<const Eigen::MatrixXf> img, double max=-1.);
 
 // Image operations --------
 
 void gaussian_blur(Eigen::Ref<const Eigen::MatrixXd> in, Eigen::Ref<Eigen::MatrixXd> out, int kernel_size=5);
+void gaussian_blur(Eigen::Ref<const Eigen::MatrixXf> in, Eigen::Ref<Eigen::MatrixXf> out, int kernel_size=5);
 
 // sampling ----------------
 
@@ -17,6 +17,9 @@ struct CLI_OTSolverOptions
 {
   otmap::SolverOptions solver_opt;
   int verbose_level;
+  int upsample_res;
+  int upsample_iter;
+  int input_res;
 
   CLI_OTSolverOptions()
   {
@@ -27,6 +30,9 @@ struct CLI_OTSolverOptions
   void set_default()
   {
     verbose_level = 1;
+    upsample_res = 0;
+    upsample_iter = 0;
+    input_res = 0;
   }
 
   static void print_help()
@@ -37,6 +43,8 @@ struct CLI_OTSolverOptions
     std::cout << " * -th  <residual threshold>" << std::endl;
     std::cout << " * -ratio <max_target_ratio>" << std::endl;
     std::cout << " * -v <verbose_level>         ; integer in [0,10], default is 1" << std::endl;
+    std::cout << " * -upsample <res> [iters]    ; upsample the maps to res x res, followed by iters warm-started iterations (default 0)" << std::endl;
+    std::cout << " * -in_res <res>              ; downsample the input images to at most res x res while loading them" << std::endl;
   }
 
   bool load(const InputParser& args)
@@ -69,6 +77,16 @@ struct CLI_OTSolverOptions
     if(args.getCmdOption("-v",value))
       verbose_level = std::stoi(value[0]);
 
+    if(args.getCmdOption("-upsample",value))
+    {
+      upsample_res = std::stoi(value[0]);
+      if(value.size()>1)
+        upsample_iter = std::stoi(value[1]);
+    }
+
+    if(args.getCmdOption("-in_res",value))
+      input_res = std::stoi(value[0]);
+
     return true;
   }
 };
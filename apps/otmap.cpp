@@ -29,6 +29,9 @@ struct CLIopts : CLI_OTSolverOptions
 {
   std::vector<std::string> inputs;
   std::string out_prefix;
+  bool save_tmap;
+  int tmap_options;
+  std::string mesh_ext;
 
   // initializes the options to their default values
   void set_default()
@@ -36,6 +39,9 @@ struct CLIopts : CLI_OTSolverOptions
     inputs.clear();
 
     out_prefix = "";
+    save_tmap = false;
+    tmap_options = TMFO_Default;
+    mesh_ext = "obj";
 
     CLI_OTSolverOptions::set_default();
   }
@@ -61,6 +67,22 @@ struct CLIopts : CLI_OTSolverOptions
     if(args.getCmdOption("-out", value))
       out_prefix = value[0];
 
+    if(args.cmdOptionExists("-save_tmap"))
+    {
+      save_tmap = true;
+      if(args.getCmdOption("-save_tmap", value))
+      {
+        for(auto& v : value)
+        {
+          if(v=="float")    tmap_options |= TMFO_SinglePrecision;
+          if(v=="compress") tmap_options |= TMFO_Compressed;
+        }
+      }
+    }
+
+    if(args.getCmdOption("-mesh_format", value))
+      mesh_ext = value[0];
+
     return true;
   }
 };
@@ -72,13 +94,15 @@ void output_usage()
   std::cout << "usage: otmap -in <inputs> <option> <value>" << std::endl;
 
   std::cout << "input options:" << std::endl;
-  std::cout << " * -in input0 [input1] where input* is either a <filename> or a procedural func \":id:res:\"" << std::endl;
+  std::cout << " * -in input0 [input1] where input* is either a <filename>, a procedural func \":id:res:\", or a previously saved .tmap file" << std::endl;
   std::cout << " *                     see analytical_functions.h for a list of possible function ids." << std::endl;
 
   CLI_OTSolverOptions::print_help();
 
   std::cout << "output options :" << std::endl;
   std::cout << " * -out <prefix>" << std::endl;
+  std::cout << " * -save_tmap [float] [compress] -> save the maps as compact binary .tmap files" << std::endl;
+  std::cout << " * -mesh_format <ext>            -> file format of the exported maps: obj (default), off, ply (binary), or grid (compact binary)" << std::endl;
 }
 // ===================================================================
 
@@ -106,14 +130,17 @@ int main(int argc, char**argv)
   std::cout << "Save densities, forward and inverse maps...\n";
   for(int k=0; k<tmaps.size(); ++k)
   {
-    tmaps[k].fwd_mesh().write(opts.out_prefix + "_" + char('u'+k) + "_fwd.obj");
+    if(opts.save_tmap)
+      write_transport_map(tmaps[k], opts.out_prefix + "_" + char('u'+k) + ".tmap", opts.tmap_options);
+
+    tmaps[k].fwd_mesh().write(opts.out_prefix + "_" + char('u'+k) + "_fwd." + opts.mesh_ext);
 
-    std::cout << "Transport cost: " << transport_cost(tmaps[k].origin_mesh(), tmaps[k].fwd_mesh(), tmaps[k].density()) << std::endl;
+    std::cout << "Transport cost: " << transport_cost(tmaps[k].origin_grid(), tmaps[k].fwd_grid(), tmaps[k].density()) << std::endl;
 
     // compute inverse map
-    Surface_mesh inv_map = tmaps[k].origin_mesh();
-    apply_inverse_map(tmaps[k], inv_map.points(), opts.verbose_level);
-    inv_map.write(opts.out_prefix + "_" + char('u'+k) + "_inv.obj");
+    Surface_mesh inv_map;
+    compute_inverse_mesh(tmaps[k], inv_map, opts.verbose_level);
+    inv_map.write(opts.out_prefix + "_" + char('u'+k) + "_inv." + opts.mesh_ext);
   }
 
   std::cout << "Generate and save composite maps...\n";
@@ -121,19 +148,23 @@ int main(int argc, char**argv)
   {
     int img_res = std::sqrt(std::min(tmaps[0].density().size(), tmaps[1].density().size()));
     // compute composite maps u->v and v->u
-    Surface_mesh map_uv = tmaps[0].fwd_mesh();
-    apply_inverse_map(tmaps[1], map_uv.points(), opts.verbose_level);
-    std::cout << "Transport cost of map u->v : " << transport_cost(tmaps[0].origin_mesh(), map_uv, tmaps[0].density()) << std::endl;
+    GridMesh map_uv = tmaps[0].origin_grid();
+    ComposedTransportMap(tmaps[0], tmaps[1]).apply_to_origin_vertices(map_uv.points(), opts.verbose_level);
+    std::cout << "Transport cost of map u->v : " << transport_cost(tmaps[0].origin_grid(), map_uv, tmaps[0].density()) << std::endl;
     synthetize_and_export_image(map_uv, img_res, tmaps[1].density(), std::string(opts.out_prefix).append("_map_uv_reconstructed"), tmaps[0].density());
-    prune_empty_faces(map_uv,tmaps[0].density());
-    map_uv.write(std::string(opts.out_prefix).append("_map_uv.obj"));
-
-    Surface_mesh map_vu = tmaps[1].fwd_mesh();
-    apply_inverse_map(tmaps[0], map_vu.points(), opts.verbose_level);
-    std::cout << "Transport cost of map v->u : " << transport_cost(tmaps[1].origin_mesh(), map_vu, tmaps[1].density()) << std::endl;
+    Surface_mesh mesh_uv;
+    map_uv.to_surface_mesh(mesh_uv);
+    prune_empty_faces(mesh_uv,tmaps[0].density());
+    mesh_uv.write(std::string(opts.out_prefix).append("_map_uv.").append(opts.mesh_ext));
+
+    GridMesh map_vu = tmaps[1].origin_grid();
+    ComposedTransportMap(tmaps[1], tmaps[0]).apply_to_origin_vertices(map_vu.points(), opts.verbose_level);
+    std::cout << "Transport cost of map v->u : " << transport_cost(tmaps[1].origin_grid(), map_vu, tmaps[1].density()) << std::endl;
     synthetize_and_export_image(map_vu, img_res, tmaps[0].density(), std::string(opts.out_prefix).append("_map_vu_reconstructed"), tmaps[1].density());
-    prune_empty_faces(map_vu,tmaps[1].density());
-    map_vu.write(std::string(opts.out_prefix).append("_map_vu.obj"));
+    Surface_mesh mesh_vu;
+    map_vu.to_surface_mesh(mesh_vu);
+    prune_empty_faces(mesh_vu,tmaps[1].density());
+    mesh_vu.write(std::string(opts.out_prefix).append("_map_vu.").append(opts.mesh_ext));
   }
 
   return 0;
@@ -37,6 +37,7 @@ void output_usage()
   std::cout << " * -ptscale <value>               -> scaling factor to apply to SVG point sizes (default 1)" << std::endl;
   std::cout << " * -pattern <value>               -> pattern = poisson or a .dat file, default is tiling from uniform_pattern_sig2012.dat" << std::endl;
   std::cout << " * -export_maps                   -> write maps as .off files" << std::endl;
+  std::cout << " * -inv_table <res>               -> invert the map through a res x res look-up table (default 0 = off)" << std::endl;
 
   std::cout << std::endl;
 
@@ -53,6 +54,7 @@ struct CLIopts : CLI_OTSolverOptions
   std::string pattern;
   bool inv_mode;
   bool export_maps;
+  int inv_table_res;
 
   std::string out_prefix;
 
@@ -67,6 +69,7 @@ struct CLIopts : CLI_OTSolverOptions
 
     pt_scale = 1;
     export_maps = 0;
+    inv_table_res = 0;
     pattern = DATA_DIR"/uniform_pattern_sig2012.dat";
 
     CLI_OTSolverOptions::set_default();
@@ -107,6 +110,9 @@ struct CLIopts : CLI_OTSolverOptions
     if(args.cmdOptionExists("-export_maps"))
       export_maps = true;
 
+    if(args.getCmdOption("-inv_table", value))
+      inv_table_res = std::atoi(value[0].c_str());
+
     return true;
   }
 };
@@ -144,7 +150,7 @@ int main(int argc, char** argv)
     std::cout << "Generate transport map...\n";
 
   MatrixXd density;
-  if(!load_input_density(opts.filename, density))
+  if(!load_input_density(opts.filename, density, opts.input_res))
   {
     std::cout << "Failed to load input \"" << opts.filename << "\" -> abort." << std::endl;
     exit(EXIT_FAILURE);
@@ -159,7 +165,7 @@ int main(int argc, char** argv)
   save_image((opts.out_prefix + "_target.png").c_str(), 1.-density.array());
 
 
-  BenchTimer t_solver_init, t_solver_compute, t_generate_uniform, t_inverse;
+  BenchTimer t_solver_init, t_solver_compute, t_generate_uniform, t_bvh, t_table, t_inverse;
 
   t_solver_init.start();
   otsolver.init(density.rows());
@@ -174,6 +180,17 @@ int main(int argc, char** argv)
   if(opts.export_maps)
     tmap.fwd_mesh().write(opts.out_prefix + "_fwd.off");
 
+  t_bvh.start();
+  tmap.init_inverse();
+  t_bvh.stop();
+
+  if(opts.inv_table_res>0)
+  {
+    t_table.start();
+    tmap.build_inverse_table(opts.inv_table_res);
+    t_table.stop();
+  }
+
   for(unsigned int i=0; i<opts.ores.size(); ++i){
     
     std::vector<Eigen::Vector2d> points;
@@ -204,6 +221,8 @@ int main(int argc, char** argv)
 
     std::cout << " # " << opts.ores[i] << "/" << points.size()
                 << "  ;  gen: " << t_generate_uniform.value(REAL_TIMER)
-                << "s  ;  bvh+inverse: " << t_inverse.value(REAL_TIMER) << "s\n";
+                << "s  ;  bvh: " << t_bvh.value(REAL_TIMER)
+                << "s  ;  table: " << t_table.total(REAL_TIMER)
+                << "s  ;  inverse: " << t_inverse.value(REAL_TIMER) << "s\n";
   }
 }
@@ -90,9 +90,7 @@ init(int n)
   m_gridSize = n;
   m_pb_size = n*n;
   
-  if(m_mesh!=nullptr) m_mesh.reset(new Surface_mesh);
-  else                m_mesh = std::make_shared<Surface_mesh>();
-  generate_quad_mesh(n+1, n+1, *m_mesh);
+  m_grid = GridMesh(n);
 
   m_element_area = 1.0/(double(n)*double(n));
   
@@ -106,6 +104,14 @@ init(int n)
 TransportMap
 GridBasedTransportSolver::solve(ConstRefVector in_density, SolverOptions opt)
 {
+  return solve(in_density, VectorXd::Zero(pb_size()), opt);
+}
+
+TransportMap
+GridBasedTransportSolver::solve(ConstRefVector in_density, ConstRefVector initial_psi, SolverOptions opt)
+{
+  assert(initial_psi.size() == pb_size());
+
   if(m_verbose_level>=1)
   {
     std::cout << " Solve transport map using beta=";
@@ -122,11 +128,11 @@ GridBasedTransportSolver::solve(ConstRefVector in_density, SolverOptions opt)
   adjust_density(*p_density, opt.max_ratio);
   m_input_density = p_density.get();
 
-  // initialize cache of vertex gradient at psi=0
-  m_cache_1D_g0.setZero(m_mesh->vertices_size(), 2);
+  // initialize cache of vertex gradient at the initial psi
+  compute_vertex_gradients(initial_psi, m_cache_1D_g0);
 
   // current and next solution
-  VectorXd xk   = VectorXd::Zero(n);
+  VectorXd xk   = initial_psi;
   VectorXd xkp1 = VectorXd::Zero(n);
 
   // residuals
@@ -221,10 +227,9 @@ GridBasedTransportSolver::solve(ConstRefVector in_density, SolverOptions opt)
 
   // makes sure m_cache_residual_vtx_grads is uptodate
   compute_vertex_gradients(xk, m_cache_residual_vtx_grads);
-  // compute forward mesh
-  auto forward_mesh = std::make_shared<Surface_mesh>(*m_mesh);
-  for(unsigned int j=0; j<m_cache_residual_vtx_grads.rows(); ++j)
-    forward_mesh->points()[j] += m_cache_residual_vtx_grads.row(j).transpose();
+  // compute forward vertex positions
+  auto forward_points = std::make_shared<std::vector<Vector2d> >(m_grid.points());
+  matrix_view(*forward_points) += m_cache_residual_vtx_grads.transpose();
 
   if(m_verbose_level >= 1) {
     std::cout << " Solution:\n";
@@ -241,7 +246,7 @@ GridBasedTransportSolver::solve(ConstRefVector in_density, SolverOptions opt)
     std::cout << "  - transport cost=" << ot_cost_per_face.sum() << std::endl;
   }
 
-  return TransportMap(m_mesh, forward_mesh, p_density);
+  return TransportMap(m_gridSize, p_density, std::make_shared<VectorXd>(xk), forward_points);
 }
 
 
@@ -268,8 +273,8 @@ initialize_laplacian_solver()
 {
   BenchTimer timer;
 
-  int nv  = m_mesh->vertices_size();
-  int nf  = m_mesh->faces_size();
+  int nv  = m_grid.n_vertices();
+  int nf  = m_grid.n_faces();
 
   assert((m_gridSize+1)*(m_gridSize+1)==nv);
   assert(m_gridSize*m_gridSize==nf);
@@ -367,22 +372,24 @@ initialize_laplacian_solver()
 
 // Fast version compatible with SIMD
 void
-GridBasedTransportSolver::
-compute_vertex_gradients(ConstRefVector psi, MatrixX2d& vtx_grads) const
+compute_vertex_gradients(int grid_size, Ref<const VectorXd> psi, MatrixX2d& vtx_grads)
 {
-  unsigned int nv = m_mesh->vertices_size();
+  auto make_face_index = [grid_size] (Index i, Index j) { return int(j+i*grid_size); };
+  auto make_vtx_index  = [grid_size] (Index i, Index j) { return int(j+i*(grid_size+1)); };
+  unsigned int nv = (grid_size+1)*(grid_size+1);
 
   vtx_grads.resize(nv,2);
 
   using namespace Eigen::internal;
   typedef packet_traits<double>::type Packet;
   const Index PacketSize = packet_traits<double>::size;
-  Index simd_size = ((m_gridSize-1)/PacketSize)*PacketSize;
+  Index simd_size = ((grid_size-1)/PacketSize)*PacketSize;
 
-  double w = double(m_gridSize);
+  double w = double(grid_size);
   Packet pw05 = pset1<Packet>(0.5*w);
   // inner cells:
-  for(Index i=1; i<m_gridSize; ++i){
+  #pragma omp parallel for
+  for(Index i=1; i<grid_size; ++i){
     int fid0 = make_face_index(i-1,0);
     int fid1 = make_face_index(i,0);
     int vid = make_vtx_index(i,0);
@@ -398,7 +405,7 @@ compute_vertex_gradients(ConstRefVector psi, MatrixX2d& vtx_grads) const
 
     double p00 = psi(fid0+simd_size-1);
     double p10 = psi(fid1+simd_size-1);
-    for(Index j=simd_size; j<m_gridSize; ++j){
+    for(Index j=simd_size; j<grid_size; ++j){
       double p01 = psi(fid0+j);
       double p11 = psi(fid1+j);
       vtx_grads(vid+j,0) = 0.5*w*(p10+p11-p00-p01);
@@ -409,23 +416,99 @@ compute_vertex_gradients(ConstRefVector psi, MatrixX2d& vtx_grads) const
   }
 
   // boundaries
-  for(int k=1; k<m_gridSize; ++k)
+  for(int k=1; k<grid_size; ++k)
   {
     vtx_grads(make_vtx_index(k,0), 0) = w*(psi(make_face_index(k, 0)) - psi(make_face_index(k-1, 0)));
     vtx_grads(make_vtx_index(k,0), 1) = 0.;
-    vtx_grads(make_vtx_index(k,m_gridSize), 0) = w*(psi(make_face_index(k, m_gridSize-1)) - psi(make_face_index(k-1, m_gridSize-1)));
-    vtx_grads(make_vtx_index(k,m_gridSize), 1) = 0.;
+    vtx_grads(make_vtx_index(k,grid_size), 0) = w*(psi(make_face_index(k, grid_size-1)) - psi(make_face_index(k-1, grid_size-1)));
+    vtx_grads(make_vtx_index(k,grid_size), 1) = 0.;
 
     vtx_grads(make_vtx_index(0,k), 0) = 0.;
     vtx_grads(make_vtx_index(0,k), 1) = w*(psi(make_face_index(0, k)) - psi(make_face_index(0, k-1)));
-    vtx_grads(make_vtx_index(m_gridSize,k), 0) = 0;
-    vtx_grads(make_vtx_index(m_gridSize,k), 1) = w*(psi(make_face_index(m_gridSize-1, k)) - psi(make_face_index(m_gridSize-1, k-1)));
+    vtx_grads(make_vtx_index(grid_size,k), 0) = 0;
+    vtx_grads(make_vtx_index(grid_size,k), 1) = w*(psi(make_face_index(grid_size-1, k)) - psi(make_face_index(grid_size-1, k-1)));
   }
   // corners
   vtx_grads.row(make_vtx_index(0,0)).setZero();
-  vtx_grads.row(make_vtx_index(m_gridSize,0)).setZero();
-  vtx_grads.row(make_vtx_index(0,m_gridSize)).setZero();
-  vtx_grads.row(make_vtx_index(m_gridSize,m_gridSize)).setZero();
+  vtx_grads.row(make_vtx_index(grid_size,0)).setZero();
+  vtx_grads.row(make_vtx_index(0,grid_size)).setZero();
+  vtx_grads.row(make_vtx_index(grid_size,grid_size)).setZero();
+}
+
+void
+upsample_potential(int grid_size, Ref<const VectorXd> psi, int new_size, VectorXd& new_psi)
+{
+  int n = grid_size;
+  double scale = double(n)/double(new_size);
+
+  // cubic B-spline weights and indices of the 4 coarse cells involved along each dimension,
+  // both dimensions share the same sampling
+  std::vector<Array4i> ids(new_size);
+  std::vector<Array4d> weights(new_size);
+  for(int k=0; k<new_size; ++k)
+  {
+    double x = (k+0.5)*scale - 0.5;
+    int k0 = int(std::floor(x));
+    double t = x - k0;
+    double s = 1.-t;
+    weights[k] << s*s*s/6.,
+                  (t*t*(3.*t-6.)+4.)/6.,
+                  (t*(t*(3.-3.*t)+3.)+1.)/6.,
+                  t*t*t/6.;
+    for(int l=0; l<4; ++l)
+      ids[k](l) = std::min(std::max(k0-1+l,0),n-1);
+  }
+
+  new_psi.resize(new_size*new_size);
+  #pragma omp parallel for
+  for(int i=0; i<new_size; ++i)
+  {
+    for(int j=0; j<new_size; ++j)
+    {
+      double val = 0;
+      for(int a=0; a<4; ++a)
+      {
+        double row = 0;
+        for(int b=0; b<4; ++b)
+          row += weights[j](b) * psi(ids[j](b) + ids[i](a)*n);
+        val += weights[i](a) * row;
+      }
+      new_psi(j+i*new_size) = val;
+    }
+  }
+}
+
+TransportMap
+upsample_transport_map(const TransportMap& tmap, int new_size, std::shared_ptr<VectorXd> density)
+{
+  assert(tmap.grid_size()>0 && tmap.has_potential());
+  int n = tmap.grid_size();
+
+  auto psi = std::make_shared<VectorXd>();
+  upsample_potential(n, tmap.potential(), new_size, *psi);
+
+  if(density==nullptr)
+  {
+    const VectorXd& coarse_density = tmap.density();
+    density = std::make_shared<VectorXd>(new_size*new_size);
+    #pragma omp parallel for
+    for(int i=0; i<new_size; ++i)
+    {
+      int ci = std::min(n-1, int((i+0.5)*n/new_size));
+      for(int j=0; j<new_size; ++j)
+        (*density)(j+i*new_size) = coarse_density(std::min(n-1, int((j+0.5)*n/new_size)) + ci*n);
+    }
+  }
+  assert(density->size()==new_size*new_size);
+
+  return TransportMap(new_size, density, psi);
+}
+
+void
+GridBasedTransportSolver::
+compute_vertex_gradients(ConstRefVector psi, MatrixX2d& vtx_grads) const
+{
+  otmap::compute_vertex_gradients(m_gridSize, psi, vtx_grads);
 }
 
 EIGEN_DONT_INLINE
@@ -456,7 +539,7 @@ double
 GridBasedTransportSolver::
 compute_residual(ConstRefVector psi, Ref<VectorXd> out) const
 {
-  unsigned int nv = m_mesh->vertices_size();
+  unsigned int nv = m_grid.n_vertices();
 
   MatrixX2d &vtx_grads(m_cache_residual_vtx_grads);
   compute_vertex_gradients(psi, vtx_grads);
@@ -476,7 +559,7 @@ compute_1D_problem_parameters(Ref<const VectorXd> psi, Ref<const VectorXd> dir,
 {
   // compute a, b, c, such that:
   // r(psi+t*dir) = a*t^2 + b*t + r(psi)
-  int nv = m_mesh->vertices_size();
+  int nv = m_grid.n_vertices();
   MatrixX2d &g0(m_cache_1D_g0);
   MatrixX2d &gd(m_cache_1D_gd);
   // No need to recompute the vertex gradient at psi,
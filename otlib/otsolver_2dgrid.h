@@ -25,8 +25,8 @@
 #include <Eigen/CholmodSupport>
 #endif
 
-#include "surface_mesh/Surface_mesh.h"
 #include "transport_map.h"
+#include "utils/grid_mesh.h"
 
 namespace otmap {
 
@@ -42,6 +42,26 @@ struct SolverOptions
   double max_ratio = std::numeric_limits<double>::max();
 };
 
+/** Computes the gradient of the potential \a psi at each vertex of the regular grid of size \a grid_size x \a grid_size.
+  * \a psi is defined per cell, and the vertices are indexed as j+i*(grid_size+1). */
+void compute_vertex_gradients(int grid_size, Eigen::Ref<const Eigen::VectorXd> psi, Eigen::MatrixX2d& vtx_grads);
+
+/** Resamples the potential \a psi defined per cell of a regular grid of size \a grid_size x \a grid_size
+  * to the cells of a grid of size \a new_size x \a new_size using bicubic B-spline filtering.
+  * Unlike interpolating cubics, the B-spline does not overshoot where the density, and thus the curvature of \a psi, varies sharply,
+  * which would fold the upsampled cells.
+  * The potential is extended by replication across the boundaries. */
+void upsample_potential(int grid_size, Eigen::Ref<const Eigen::VectorXd> psi, int new_size, Eigen::VectorXd& new_psi);
+
+/** \returns the transport map \a tmap resampled on a regular grid of size \a new_size x \a new_size,
+  * without solving the transport problem at the new resolution.
+  * The potential of \a tmap is smoothly interpolated by upsample_potential and the forward vertices are regenerated from it.
+  * If \a density is null, the density of \a tmap is upsampled as a piecewise constant function.
+  * The result only approximately preserves the mass of the cells, exact mass preservation is recovered by
+  * a few iterations of GridBasedTransportSolver::solve(density, tmap.potential(), opt) at the new resolution.
+  * \a tmap must be a grid-based transport map holding its potential. */
+TransportMap upsample_transport_map(const TransportMap& tmap, int new_size, std::shared_ptr<Eigen::VectorXd> density = nullptr);
+
 class GridBasedTransportSolver
 {
 public:
@@ -57,6 +77,10 @@ public:
   /** solve for the given density */
   TransportMap solve(Eigen::Ref<const Eigen::VectorXd> density, SolverOptions opt = SolverOptions());
 
+  /** solve for the given density starting from the potential \a initial_psi instead of 0,
+    * e.g., the one of a transport map upsampled from a coarser grid by upsample_transport_map */
+  TransportMap solve(Eigen::Ref<const Eigen::VectorXd> density, Eigen::Ref<const Eigen::VectorXd> initial_psi, SolverOptions opt = SolverOptions());
+
 protected:
 
   typedef Eigen::Ref<const Eigen::VectorXd> ConstRefVector;
@@ -92,7 +116,7 @@ protected:
 
 protected:
   // the working quad mesh
-  std::shared_ptr<surface_mesh::Surface_mesh> m_mesh;
+  GridMesh m_grid;
 
   // the input density
   const Eigen::VectorXd* m_input_density;
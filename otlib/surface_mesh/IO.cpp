@@ -55,6 +55,10 @@ bool read_mesh(Surface_mesh& mesh, const std::string& filename)
     {
         return read_obj(mesh, filename);
     }
+    else if (ext == "grid")
+    {
+        return read_grid(mesh, filename);
+    }
 
     // we didn't find a reader module
     return false;
@@ -82,6 +86,14 @@ bool write_mesh(const Surface_mesh& mesh, const std::string& filename)
     {
         return write_obj(mesh, filename);
     }
+    else if(ext=="ply")
+    {
+        return write_ply(mesh, filename);
+    }
+    else if(ext=="grid")
+    {
+        return write_grid(mesh, filename);
+    }
 
     // we didn't find a writer module
     return false;
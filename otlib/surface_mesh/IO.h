@@ -41,11 +41,19 @@ namespace surface_mesh {
 bool read_mesh(Surface_mesh& mesh, const std::string& filename);
 bool read_off(Surface_mesh& mesh, const std::string& filename);
 bool read_obj(Surface_mesh& mesh, const std::string& filename);
+bool read_grid(Surface_mesh& mesh, const std::string& filename);
 
 bool write_mesh(const Surface_mesh& mesh, const std::string& filename);
 bool write_off(const Surface_mesh& mesh, const std::string& filename);
 bool write_obj(const Surface_mesh& mesh, const std::string& filename);
 
+/// binary PLY (positions and faces only)
+bool write_ply(const Surface_mesh& mesh, const std::string& filename);
+
+/// compact binary format storing only the positions when the faces are those of a regular
+/// quad grid as created by generate_quad_mesh, and the explicit list of faces otherwise
+bool write_grid(const Surface_mesh& mesh, const std::string& filename);
+
 //=============================================================================
 } // namespace surface_mesh
 //=============================================================================
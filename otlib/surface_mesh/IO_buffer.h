@@ -0,0 +1,356 @@
+//=============================================================================
+// Copyright (C) 2001-2005 by Computer Graphics Group, RWTH Aachen
+// Copyright (C) 2011-2013 by Graphics & Geometry Group, Bielefeld University
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public License
+// as published by the Free Software Foundation, version 2.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//=============================================================================
+
+
+#ifndef SURFACE_MESH_IO_BUFFER_H
+#define SURFACE_MESH_IO_BUFFER_H
+
+
+//== INCLUDES =================================================================
+
+
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+//== NAMESPACE ================================================================
+
+
+namespace surface_mesh {
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// Accumulates small writes into a large memory buffer that is passed to
+/// fwrite once full, so that the cost of the stdio calls is paid per chunk
+/// and not per element. Used by the mesh writers.
+class Buffered_writer
+{
+public:
+
+    /// the file must be opened by the caller, it is not closed by the writer
+    Buffered_writer(FILE* out, size_t capacity = size_t(1)<<22)
+        : out_(out), ok_(out != NULL)
+    {
+        buffer_.reserve(capacity);
+    }
+
+    ~Buffered_writer() { flush(); }
+
+    /// append \c size bytes
+    void write(const void* data, size_t size)
+    {
+        if (buffer_.size() + size > buffer_.capacity())
+            flush();
+        if (size >= buffer_.capacity())
+        {
+            ok_ = ok_ && fwrite(data, 1, size, out_) == size;
+            return;
+        }
+        const char* c = static_cast<const char*>(data);
+        buffer_.insert(buffer_.end(), c, c + size);
+    }
+
+    /// append the raw bytes of \c t
+    template <typename T> void write_raw(const T& t)
+    {
+        write(&t, sizeof(T));
+    }
+
+    /// append a null terminated string, without its terminating character
+    void write_string(const char* str)
+    {
+        write(str, strlen(str));
+    }
+
+    /// pass the buffered bytes to the file, returns false if any write failed so far
+    bool flush()
+    {
+        if (!buffer_.empty())
+        {
+            ok_ = ok_ && fwrite(buffer_.data(), 1, buffer_.size(), out_) == buffer_.size();
+            buffer_.clear();
+        }
+        return ok_;
+    }
+
+private:
+
+    FILE*              out_;
+    bool               ok_;
+    std::vector<char>  buffer_;
+};
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// Growable character buffer with std::to_chars based formatting, the output
+/// of put(double,precision) is identical to printf("%.<precision>f").
+class Text_buffer
+{
+public:
+
+    Text_buffer() : size_(0) {}
+
+    void clear() { size_ = 0; }
+
+    const char* data() const { return data_.data(); }
+    size_t size() const { return size_; }
+
+    void put(char c)
+    {
+        *room(1) = c;
+        ++size_;
+    }
+
+    void put(const char* str)
+    {
+        size_t n = strlen(str);
+        std::memcpy(room(n), str, n);
+        size_ += n;
+    }
+
+    void put(int v)
+    {
+        char* p = room(16);
+        size_ = std::to_chars(p, p+16, v).ptr - data_.data();
+    }
+
+    void put(double v, int precision)
+    {
+        // large enough for any double in fixed notation
+        const size_t max_size = 330 + precision;
+        char* p = room(max_size);
+        size_ = std::to_chars(p, p+max_size, v, std::chars_format::fixed, precision).ptr - data_.data();
+    }
+
+private:
+
+    // returns a pointer to at least n free characters at the end of the buffer
+    char* room(size_t n)
+    {
+        if (size_+n > data_.size())
+            data_.resize(std::max(2*data_.size(), size_+n));
+        return data_.data() + size_;
+    }
+
+    std::vector<char>  data_;
+    size_t             size_;
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Gathers the handles of the range [begin,end), used to index the non deleted elements of a mesh.
+template <typename Handle, typename Iterator>
+std::vector<Handle> collect_handles(Iterator begin, Iterator end)
+{
+    std::vector<Handle> handles;
+    for (; begin!=end; ++begin)
+        handles.push_back(*begin);
+    return handles;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Writes the text of the elements 0..n-1, as formatted by format(i,buffer), to \c out.
+/// The elements are formatted in parallel per blocks of consecutive elements, and the
+/// blocks are written in order by a few large fwrite calls. Returns false if a write failed.
+template <typename Format>
+bool write_text_blocks(FILE* out, int n, Format format)
+{
+    const int block_size = 1<<14;
+    const int batch_size = 32;
+    int nb_blocks = (n + block_size - 1) / block_size;
+
+    std::vector<Text_buffer> buffers(std::min(batch_size, nb_blocks));
+    bool ok = true;
+    for (int b0=0; b0<nb_blocks && ok; b0+=batch_size)
+    {
+        int b1 = std::min(nb_blocks, b0+batch_size);
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int b=b0; b<b1; ++b)
+        {
+            Text_buffer& buffer = buffers[b-b0];
+            buffer.clear();
+            int end = std::min(n, (b+1)*block_size);
+            for (int i=b*block_size; i<end; ++i)
+                format(i, buffer);
+        }
+
+        for (int b=b0; b<b1 && ok; ++b)
+            ok = fwrite(buffers[b-b0].data(), 1, buffers[b-b0].size(), out) == buffers[b-b0].size();
+    }
+    return ok;
+}
+
+
+//== CLASS DEFINITION =========================================================
+
+
+/// Read-only view of the content of a file. The file is memory mapped when
+/// possible, and read at once in a buffer otherwise.
+class Mapped_file
+{
+public:
+
+    explicit Mapped_file(const std::string& filename)
+        : data_(NULL), size_(0), open_(false), mapped_(false)
+    {
+#ifndef _WIN32
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd >= 0)
+        {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED)
+                {
+                    data_ = static_cast<const char*>(data);
+                    size_ = st.st_size;
+                    open_ = mapped_ = true;
+                }
+            }
+            close(fd);
+            if (mapped_)
+                return;
+        }
+#endif
+
+        // fallback to regular reads
+        FILE* in = fopen(filename.c_str(), "rb");
+        if (!in)
+            return;
+        char chunk[1<<16];
+        size_t count;
+        while ((count = fread(chunk, 1, sizeof(chunk), in)) > 0)
+            buffer_.insert(buffer_.end(), chunk, chunk+count);
+        fclose(in);
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+        open_ = true;
+    }
+
+    ~Mapped_file()
+    {
+#ifndef _WIN32
+        if (mapped_)
+            munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+
+    /// true if the file could be read, even if it is empty
+    bool is_open() const { return open_; }
+
+    const char* begin() const { return data_; }
+    const char* end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+
+private:
+
+    Mapped_file(const Mapped_file&);
+    Mapped_file& operator=(const Mapped_file&);
+
+    const char*        data_;
+    size_t             size_;
+    bool               open_;
+    bool               mapped_;
+    std::vector<char>  buffer_;
+};
+
+
+//-----------------------------------------------------------------------------
+
+
+/// Returns the start of each line of [begin,end), the line breaks are searched in parallel per chunks.
+inline std::vector<const char*> split_lines(const char* begin, const char* end)
+{
+    const size_t chunk_size = size_t(1)<<20;
+    size_t size = end - begin;
+    int nb_chunks = int((size + chunk_size - 1) / chunk_size);
+
+    std::vector< std::vector<const char*> > chunk_lines(nb_chunks);
+    #pragma omp parallel for schedule(dynamic)
+    for (int c=0; c<nb_chunks; ++c)
+    {
+        const char* p = begin + c*chunk_size;
+        const char* chunk_end = std::min(end, p + chunk_size);
+        while ((p = static_cast<const char*>(memchr(p, '\n', chunk_end-p))) != NULL && ++p < end)
+            chunk_lines[c].push_back(p);
+    }
+
+    std::vector<const char*> lines;
+    if (begin < end)
+        lines.push_back(begin);
+    for (int c=0; c<nb_chunks; ++c)
+        lines.insert(lines.end(), chunk_lines[c].begin(), chunk_lines[c].end());
+    return lines;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+/// skips the spaces and tabs, but not the line breaks
+inline const char* skip_blanks(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    return p;
+}
+
+
+/// Parses the number following the blanks at p with std::from_chars, and moves p after it.
+/// As the parsing stops at the first line break, end can be the end of the file.
+template <typename T>
+bool parse_number(const char*& p, const char* end, T& value)
+{
+    p = skip_blanks(p, end);
+    if (p < end && *p == '+')
+        ++p;
+    std::from_chars_result res = std::from_chars(p, end, value);
+    if (res.ec != std::errc())
+        return false;
+    p = res.ptr;
+    return true;
+}
+
+
+//=============================================================================
+} // namespace surface_mesh
+//=============================================================================
+#endif // SURFACE_MESH_IO_BUFFER_H
+//=============================================================================
@@ -0,0 +1,229 @@
+//=============================================================================
+// Copyright (C) 2001-2005 by Computer Graphics Group, RWTH Aachen
+// Copyright (C) 2011-2013 by Graphics & Geometry Group, Bielefeld University
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public License
+// as published by the Free Software Foundation, version 2.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//=============================================================================
+
+
+//== INCLUDES =================================================================
+
+
+#include <surface_mesh/IO.h>
+#include <surface_mesh/IO_buffer.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+
+//== NAMESPACE ================================================================
+
+
+namespace surface_mesh {
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+// File layout (little endian):
+//  - header (see below)
+//  - the 2D positions of the n_vertices vertices, as pairs of doubles
+//  - if rows==0, the faces as n_faces lists of uint32: valence followed by the vertex indices.
+//    Otherwise the faces are the quads of the implicit rows x cols vertex grid
+//    created by generate_quad_mesh(rows,cols), and are not stored.
+struct Grid_file_header
+{
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  rows;
+    uint32_t  cols;
+    uint32_t  n_vertices;
+    uint32_t  n_faces;
+    uint32_t  reserved;
+};
+
+static const char grid_magic[8] = {'S','M','G','R','I','D','B','N'};
+static const uint32_t grid_version = 1;
+
+
+//-----------------------------------------------------------------------------
+
+
+// Checks whether the faces of mesh are exactly the quads of a rows x cols vertex grid,
+// in the order and with the orientation of generate_quad_mesh.
+static bool is_implicit_grid(const Surface_mesh& mesh, unsigned int& rows, unsigned int& cols)
+{
+    rows = cols = 0;
+    if (mesh.n_vertices()!=mesh.vertices_size() || mesh.n_faces()!=mesh.faces_size() || mesh.n_faces()==0)
+        return false;
+
+    // vertex (i,j) has index j+i*rows, thus the second vertex of the first face gives rows
+    Surface_mesh::Vertex_around_face_circulator fvit = mesh.vertices(Surface_mesh::Face(0));
+    ++fvit;
+    unsigned int m = (*fvit).idx();
+    if (m<2 || mesh.n_vertices()%m!=0)
+        return false;
+    unsigned int n = mesh.n_vertices()/m;
+    if (n<2 || mesh.n_faces()!=(m-1)*(n-1))
+        return false;
+
+    for (unsigned int i=0; i<n-1; ++i)
+    {
+        for (unsigned int j=0; j<m-1; ++j)
+        {
+            const int expected[4] = { int(j+i*m), int(j+(i+1)*m), int(j+1+(i+1)*m), int(j+1+i*m) };
+            int k = 0;
+            Surface_mesh::Vertex_around_face_circulator fvit=mesh.vertices(Surface_mesh::Face(j+i*(m-1))), fvend=fvit;
+            do
+            {
+                if (k==4 || (*fvit).idx()!=expected[k])
+                    return false;
+                ++k;
+            }
+            while (++fvit != fvend);
+            if (k!=4)
+                return false;
+        }
+    }
+
+    rows = m;
+    cols = n;
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool write_grid(const Surface_mesh& mesh, const std::string& filename)
+{
+    FILE* out = fopen(filename.c_str(), "wb");
+    if (!out)
+        return false;
+
+    Grid_file_header header;
+    std::memcpy(header.magic, grid_magic, sizeof(grid_magic));
+    header.version = grid_version;
+    is_implicit_grid(mesh, header.rows, header.cols);
+    header.n_vertices = mesh.n_vertices();
+    header.n_faces = mesh.n_faces();
+    header.reserved = 0;
+
+    Buffered_writer writer(out);
+    writer.write_raw(header);
+
+    // vertices
+    Surface_mesh::Vertex_property<Point> points = mesh.get_vertex_property<Point>("v:point");
+    if (mesh.n_vertices()==mesh.vertices_size())
+    {
+        writer.write(points.data(), mesh.n_vertices()*sizeof(Point));
+    }
+    else
+    {
+        for (Surface_mesh::Vertex_iterator vit=mesh.vertices_begin(); vit!=mesh.vertices_end(); ++vit)
+            writer.write_raw(points[*vit]);
+    }
+
+    // explicit faces
+    if (header.rows==0)
+    {
+        for (Surface_mesh::Face_iterator fit=mesh.faces_begin(); fit!=mesh.faces_end(); ++fit)
+        {
+            writer.write_raw(uint32_t(mesh.valence(*fit)));
+            Surface_mesh::Vertex_around_face_circulator fvit=mesh.vertices(*fit), fvend=fvit;
+            do
+            {
+                writer.write_raw(uint32_t((*fvit).idx()));
+            }
+            while (++fvit != fvend);
+        }
+    }
+
+    bool ok = writer.flush();
+    fclose(out);
+    return ok;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool read_grid(Surface_mesh& mesh, const std::string& filename)
+{
+    FILE* in = fopen(filename.c_str(), "rb");
+    if (!in)
+        return false;
+
+    Grid_file_header header;
+    if (fread(&header, sizeof(header), 1, in)!=1
+        || std::memcmp(header.magic, grid_magic, sizeof(grid_magic))!=0
+        || header.version>grid_version
+        || (header.rows!=0 && (header.rows<2 || header.cols<2
+                               || header.n_vertices!=header.rows*header.cols
+                               || header.n_faces!=(header.rows-1)*(header.cols-1))))
+    {
+        fclose(in);
+        return false;
+    }
+
+    std::vector<Point> points(header.n_vertices);
+    if (fread(points.data(), sizeof(Point), points.size(), in)!=points.size())
+    {
+        fclose(in);
+        return false;
+    }
+
+    bool ok = true;
+    if (header.rows!=0)
+    {
+        mesh.build_quad_grid(header.rows, header.cols);
+        mesh.points().swap(points);
+    }
+    else
+    {
+        mesh.clear();
+        mesh.reserve(header.n_vertices, header.n_vertices+header.n_faces, header.n_faces);
+        for (const Point& p : points)
+            mesh.add_vertex(p);
+
+        std::vector<Surface_mesh::Vertex> vertices;
+        std::vector<uint32_t> indices;
+        for (unsigned int i=0; i<header.n_faces && ok; ++i)
+        {
+            uint32_t nV;
+            ok = fread(&nV, sizeof(nV), 1, in)==1 && nV>=3;
+            if (!ok)
+                break;
+            indices.resize(nV);
+            vertices.resize(nV);
+            ok = fread(indices.data(), sizeof(uint32_t), nV, in)==nV;
+            for (uint32_t j=0; j<nV && ok; ++j)
+            {
+                ok = indices[j]<header.n_vertices;
+                vertices[j] = Surface_mesh::Vertex(indices[j]);
+            }
+            if (ok)
+                mesh.add_face(vertices);
+        }
+    }
+
+    fclose(in);
+    return ok;
+}
+
+
+//=============================================================================
+} // namespace surface_mesh
+//=============================================================================
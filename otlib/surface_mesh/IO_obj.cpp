@@ -20,8 +20,10 @@
 //== INCLUDES =================================================================
 
 #include <surface_mesh/IO.h>
+#include <surface_mesh/IO_buffer.h>
 
 #include <cstdio>
+#include <cctype>
 
 
 //== NAMESPACES ===============================================================
@@ -33,158 +35,180 @@ namespace surface_mesh {
 //== IMPLEMENTATION ===========================================================
 
 
-bool read_obj(Surface_mesh& mesh, const std::string& filename)
+// elements parsed from a block of lines of an OBJ file
+struct Obj_block
 {
-    char   s[200];
-    float  x, y, z;
-    std::vector<Surface_mesh::Vertex>  vertices;
-    std::vector<Texture_coordinate> all_tex_coords;   //individual texture coordinates
-    std::vector<int> halfedge_tex_idx; //texture coordinates sorted for halfedges
-    Surface_mesh::Halfedge_property <Texture_coordinate> tex_coords = mesh.halfedge_property<Texture_coordinate>("h:texcoord");
-    bool with_tex_coord=false;
-
-    // clear mesh
-    mesh.clear();
+    std::vector<Point>               points;
+    std::vector<Texture_coordinate>  tex_coords;
+    std::vector<int>                 face_sizes;
+    std::vector<int>                 face_vertices;  // 0-based vertex index
+    std::vector<int>                 face_tex_idx;   // 0-based texture coordinate index, or -1
+};
 
 
-    // open file (in ASCII mode)
-    FILE* in = fopen(filename.c_str(), "r");
-    if (!in) return false;
+//-----------------------------------------------------------------------------
 
 
-    // clear line once
-    memset(&s, 0, 200);
+static void parse_obj_line(const char* p, const char* end, Obj_block& block)
+{
+    // comment
+    if (p+1 >= end || p[0] == '#' || isspace(p[0])) return;
 
+    double x, y, z;
 
-    // parse line by line (currently only supports vertex positions & faces
-    while(in && !feof(in) && fgets(s, 200, in))
+    // vertex
+    if (p[0] == 'v' && p[1] == ' ')
     {
-        // comment
-        if (s[0] == '#' || isspace(s[0])) continue;
-
-        // vertex
-        else if (strncmp(s, "v ", 2) == 0)
+        p += 2;
+        if (parse_number(p, end, x))
         {
-            if (sscanf(s, "v %f %f %f", &x, &y, &z))
-            {
-                mesh.add_vertex(make_point(x,y,z));
-            }
+            y = z = 0;
+            if (parse_number(p, end, y))
+                parse_number(p, end, z);
+            block.points.push_back(make_point(x,y,z));
         }
-        // normal
-        else if (strncmp(s, "vn ", 3) == 0)
+    }
+    // normal, problematic as it can be either a vertex property when interpolated
+    // or a halfedge property for hard edges
+    else if (p[0] == 'v' && p[1] == 'n')
+    {
+    }
+    // texture coordinate
+    else if (p[0] == 'v' && p[1] == 't' && p+2 < end && p[2] == ' ')
+    {
+        p += 3;
+        if (parse_number(p, end, x))
         {
-          if (sscanf(s, "vn %f %f %f", &x, &y, &z))
-          {
-            // problematic as it can be either a vertex property when interpolated
-            // or a halfedge property for hard edges
-          }
+            y = 0;
+            parse_number(p, end, y);
+            block.tex_coords.push_back(Texture_coordinate(x,y));
         }
-
-        // texture coordinate
-        else if (strncmp(s, "vt ", 3) == 0)
+    }
+    // face: v, v/t, v/t/n, or v//n
+    else if (p[0] == 'f' && p[1] == ' ')
+    {
+        ++p;
+        int nV = 0, v, t, n;
+        while (parse_number(p, end, v))
         {
-          if (sscanf(s, "vt %f %f", &x, &y))
-          {
-            all_tex_coords.push_back(Texture_coordinate(x,y));
-          }
+            // the optional components directly follow their separator
+            t = 0;
+            if (p < end && *p == '/')
+            {
+                ++p;
+                if (p < end && (isdigit(*p) || *p == '-'))
+                    parse_number(p, end, t);
+                if (p < end && *p == '/')
+                {
+                    ++p;
+                    if (p < end && (isdigit(*p) || *p == '-'))
+                        parse_number(p, end, n);
+                }
+            }
+            block.face_vertices.push_back(v-1);
+            block.face_tex_idx.push_back(t-1);
+            ++nV;
         }
+        block.face_sizes.push_back(nV);
+    }
+}
 
-        // face
-        else if (strncmp(s, "f ", 2) == 0)
-        {
-          int component(0), nV(0);
-          bool endOfVertex(false);
-          char *p0, *p1(s+1);
 
-          vertices.clear();
-          halfedge_tex_idx.clear();
+//-----------------------------------------------------------------------------
 
-          // skip white-spaces
-          while (*p1==' ') ++p1;
 
-          while (p1)
-          {
-            p0 = p1;
+// The file is memory mapped and split into lines, the blocks of lines are parsed
+// in parallel, and the mesh is then built at once from the parsed elements in file order.
+bool read_obj(Surface_mesh& mesh, const std::string& filename)
+{
+    Surface_mesh::Halfedge_property <Texture_coordinate> tex_coords = mesh.halfedge_property<Texture_coordinate>("h:texcoord");
 
-            // overwrite next separator
+    // clear mesh
+    mesh.clear();
 
-            // skip '/', '\n', ' ', '\0', '\r' <-- don't forget Windows
-            while (*p1!='/' && *p1!='\r' && *p1!='\n' && *p1!=' ' && *p1!='\0') ++p1;
+    Mapped_file file(filename);
+    if (!file.is_open()) return false;
 
-            // detect end of vertex
-            if (*p1 != '/')
-            {
-              endOfVertex = true;
-            }
+    std::vector<const char*> lines = split_lines(file.begin(), file.end());
 
-            // replace separator by '\0'
-            if (*p1 != '\0')
-            {
-              *p1 = '\0';
-              p1++; // point to next token
-            }
+    const int block_size = 1<<15;
+    int nb_blocks = (int(lines.size()) + block_size - 1) / block_size;
+    std::vector<Obj_block> blocks(nb_blocks);
+    #pragma omp parallel for schedule(dynamic)
+    for (int b=0; b<nb_blocks; ++b)
+    {
+        int end = std::min(int(lines.size()), (b+1)*block_size);
+        for (int i=b*block_size; i<end; ++i)
+            parse_obj_line(lines[i], file.end(), blocks[b]);
+    }
 
-            // detect end of line and break
-            if (*p1 == '\0' || *p1 == '\n')
-            {
-              p1 = 0;
-            }
+    // gather the parsed elements
+    std::vector<size_t> vertex_offsets(nb_blocks+1, 0);
+    std::vector<Texture_coordinate> all_tex_coords;
+    std::vector<int> face_sizes, face_vertices, face_tex_idx;
+    for (int b=0; b<nb_blocks; ++b)
+    {
+        const Obj_block& block = blocks[b];
+        vertex_offsets[b+1] = vertex_offsets[b] + block.points.size();
+        all_tex_coords.insert(all_tex_coords.end(), block.tex_coords.begin(), block.tex_coords.end());
+        face_sizes.insert(face_sizes.end(), block.face_sizes.begin(), block.face_sizes.end());
+        face_vertices.insert(face_vertices.end(), block.face_vertices.begin(), block.face_vertices.end());
+        face_tex_idx.insert(face_tex_idx.end(), block.face_tex_idx.begin(), block.face_tex_idx.end());
+    }
 
-            // read next vertex component
-            if (*p0 != '\0')
-            {
-              switch (component)
-              {
-                case 0: // vertex
-                {
-                  vertices.push_back( Surface_mesh::Vertex(atoi(p0) - 1) );
-                  break;
-                }
-                case 1: // texture coord
-                {
-                  int idx = atoi(p0)-1;
-                  halfedge_tex_idx.push_back(idx);
-                  with_tex_coord=true;
-                  break;
-                }
-                case 2: // normal
-                  break;
-              }
-            }
+    // build the mesh
+    mesh.add_vertices(vertex_offsets[nb_blocks]);
+    std::vector<Point>& points = mesh.points();
+    #pragma omp parallel for
+    for (int b=0; b<nb_blocks; ++b)
+        std::copy(blocks[b].points.begin(), blocks[b].points.end(), points.begin()+vertex_offsets[b]);
 
-            ++component;
+    int nf = face_sizes.size();
+    std::vector<size_t> face_offsets(nf+1, 0);
+    for (int i=0; i<nf; ++i)
+        face_offsets[i+1] = face_offsets[i] + face_sizes[i];
 
-            if (endOfVertex)
-            {
-              component = 0;
-              nV++;
-              endOfVertex = false;
-            }
-          }
-
-          Surface_mesh::Face f=mesh.add_face(vertices);
-
-
-          // add texture coordinates
-          if(with_tex_coord)
-          {
-              Surface_mesh::Halfedge_around_face_circulator h_fit = mesh.halfedges(f);
-              Surface_mesh::Halfedge_around_face_circulator h_end = h_fit;
-              unsigned v_idx =0;
-              do
-              {
-                  tex_coords[*h_fit]=all_tex_coords.at(halfedge_tex_idx.at(v_idx));
-                  ++v_idx;
-                  ++h_fit;
-              }
-              while(h_fit!=h_end);
-          }
+    std::vector<Surface_mesh::Face> faces(nf);
+    if (mesh.add_faces(face_sizes, face_vertices))
+    {
+        for (int i=0; i<nf; ++i)
+            faces[i] = Surface_mesh::Face(i);
+    }
+    else
+    {
+        // non manifold meshes are built face by face
+        std::vector<Surface_mesh::Vertex> vertices;
+        for (int i=0; i<nf; ++i)
+        {
+            vertices.resize(face_sizes[i]);
+            for (int k=0; k<face_sizes[i]; ++k)
+                vertices[k] = Surface_mesh::Vertex(face_vertices[face_offsets[i]+k]);
+            faces[i] = mesh.add_face(vertices);
         }
-        // clear line
-        memset(&s, 0, 200);
     }
 
-    fclose(in);
+    // add texture coordinates
+    #pragma omp parallel for
+    for (int i=0; i<nf; ++i)
+    {
+        bool with_tex_coord = face_sizes[i]>0 && faces[i].is_valid();
+        for (size_t k=face_offsets[i]; k<face_offsets[i+1]; ++k)
+            with_tex_coord = with_tex_coord && face_tex_idx[k]>=0 && face_tex_idx[k]<int(all_tex_coords.size());
+        if (!with_tex_coord)
+            continue;
+
+        Surface_mesh::Halfedge_around_face_circulator h_fit = mesh.halfedges(faces[i]);
+        Surface_mesh::Halfedge_around_face_circulator h_end = h_fit;
+        size_t v_idx = face_offsets[i];
+        do
+        {
+            tex_coords[*h_fit] = all_tex_coords[face_tex_idx[v_idx]];
+            ++v_idx;
+            ++h_fit;
+        }
+        while (h_fit!=h_end);
+    }
+
     return true;
 }
 
@@ -201,24 +225,33 @@ bool write_obj(const Surface_mesh& mesh, const std::string& filename)
     // comment
     fprintf(out, "# OBJ export from Surface_mesh\n");
 
+    // the elements are formatted in parallel blocks, see write_text_blocks
+    std::vector<Surface_mesh::Vertex> vertices = collect_handles<Surface_mesh::Vertex>(mesh.vertices_begin(), mesh.vertices_end());
+    bool ok = true;
+
     //vertices
     Surface_mesh::Vertex_property<Point> points = mesh.get_vertex_property<Point>("v:point");
-    for (Surface_mesh::Vertex_iterator vit=mesh.vertices_begin(); vit!=mesh.vertices_end(); ++vit)
+    ok = ok && write_text_blocks(out, vertices.size(), [&](int i, Text_buffer& buffer)
     {
-        Vec3 p = make_vec3(points[*vit]);
-        fprintf(out, "v %.10f %.10f %.10f\n", p[0], p[1], p[2]);
-    }
+        Vec3 p = make_vec3(points[vertices[i]]);
+        buffer.put("v ");
+        buffer.put(p[0], 10); buffer.put(' ');
+        buffer.put(p[1], 10); buffer.put(' ');
+        buffer.put(p[2], 10); buffer.put('\n');
+    });
 
     //normals
     Surface_mesh::Vertex_property<Point> normals = mesh.get_vertex_property<Point>("v:normal");
     bool with_normals = (normals != NULL);
     if(with_normals)
-        for (Surface_mesh::Vertex_iterator vit=mesh.vertices_begin(); vit!=mesh.vertices_end(); ++vit)
+        ok = ok && write_text_blocks(out, vertices.size(), [&](int i, Text_buffer& buffer)
         {
-            const Point& p = normals[*vit];
-            fprintf(out, "vn %.10f %.10f %.10f\n", p[0], p[1], p[2]);
-
-        }
+            Vec3 p = make_vec3(normals[vertices[i]]);
+            buffer.put("vn ");
+            buffer.put(p[0], 10); buffer.put(' ');
+            buffer.put(p[1], 10); buffer.put(' ');
+            buffer.put(p[2], 10); buffer.put('\n');
+        });
 
     //optionally texture coordinates
     // do we have them?
@@ -239,50 +272,53 @@ bool write_obj(const Surface_mesh& mesh, const std::string& filename)
     if(with_tex_coord)
     {
         Surface_mesh::Halfedge_property<Texture_coordinate> tex_coord = mesh.get_halfedge_property<Texture_coordinate>("h:texcoord");
-        for (Surface_mesh::Halfedge_iterator hit=mesh.halfedges_begin(); hit!=mesh.halfedges_end(); ++hit)
+        std::vector<Surface_mesh::Halfedge> halfedges = collect_handles<Surface_mesh::Halfedge>(mesh.halfedges_begin(), mesh.halfedges_end());
+        ok = ok && write_text_blocks(out, halfedges.size(), [&](int i, Text_buffer& buffer)
         {
-            const Texture_coordinate& pt = tex_coord[*hit];
-            fprintf(out, "vt %.10f %.10f\n", pt[0], pt[1]);
-        }
+            const Texture_coordinate& pt = tex_coord[halfedges[i]];
+            buffer.put("vt ");
+            buffer.put(pt[0], 10); buffer.put(' ');
+            buffer.put(pt[1], 10); buffer.put('\n');
+        });
     }
 
     //faces
-    for (Surface_mesh::Face_iterator fit=mesh.faces_begin(); fit!=mesh.faces_end(); ++fit)
+    std::vector<Surface_mesh::Face> faces = collect_handles<Surface_mesh::Face>(mesh.faces_begin(), mesh.faces_end());
+    ok = ok && write_text_blocks(out, faces.size(), [&](int i, Text_buffer& buffer)
     {
-        fprintf(out, "f");
-        Surface_mesh::Vertex_around_face_circulator fvit=mesh.vertices(*fit), fvend=fvit;
-        Surface_mesh::Halfedge_around_face_circulator fhit=mesh.halfedges(*fit);
+        buffer.put('f');
+        Surface_mesh::Vertex_around_face_circulator fvit=mesh.vertices(faces[i]), fvend=fvit;
+        Surface_mesh::Halfedge_around_face_circulator fhit=mesh.halfedges(faces[i]);
         do
         {
+            buffer.put(' ');
+            buffer.put((*fvit).idx()+1);
             if(with_tex_coord && with_normals)
             {
                 // write vertex index, tex_coord index and normal index
-                fprintf(out, " %d/%d/%d", (*fvit).idx()+1, (*fhit).idx()+1, (*fvit).idx()+1);
+                buffer.put('/'); buffer.put((*fhit).idx()+1);
+                buffer.put('/'); buffer.put((*fvit).idx()+1);
                 ++fhit;
             }
             else if(with_tex_coord)
             {
                 // write vertex index and tex_coord index
-                fprintf(out, " %d/%d/", (*fvit).idx()+1, (*fhit).idx()+1);
-                 ++fhit;
+                buffer.put('/'); buffer.put((*fhit).idx()+1);
+                buffer.put('/');
+                ++fhit;
             }
             else if(with_normals)
             {
                 // write vertex index and normal index
-                fprintf(out, " %d//%d", (*fvit).idx()+1, (*fvit).idx()+1);
-            }
-            else
-            {
-                // write vertex index
-                fprintf(out, " %d", (*fvit).idx()+1);
+                buffer.put("//"); buffer.put((*fvit).idx()+1);
             }
         }
         while (++fvit != fvend);
-        fprintf(out, "\n");
-    }
+        buffer.put('\n');
+    });
 
     fclose(out);
-    return true;
+    return ok;
 }
 
 
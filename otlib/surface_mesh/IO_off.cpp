@@ -21,6 +21,7 @@
 
 
 #include <surface_mesh/IO.h>
+#include <surface_mesh/IO_buffer.h>
 
 #include <cstdio>
 
@@ -45,19 +46,44 @@ template <typename T> void read(FILE* in, T& t)
 //-----------------------------------------------------------------------------
 
 
+// The body of the file (after the header line) is given as a memory range. It is split
+// into lines, the vertex lines are parsed in parallel directly into the mesh properties,
+// and the face lines in parallel per blocks before the connectivity is built at once.
 bool read_off_ascii(Surface_mesh& mesh,
-                    FILE* in,
+                    const char* begin,
+                    const char* end,
                     const bool has_normals,
                     const bool has_texcoords,
                     const bool has_colors)
 {
-    char                 line[200], *lp;
-    int                  nc;
-    unsigned int         i, j, items, idx;
     unsigned int         nV, nF, nE;
-    Vec3                p, n, c;
-    Vec2                t;
-    Surface_mesh::Vertex v;
+
+
+    // non empty lines, except comments
+    std::vector<const char*> lines = split_lines(begin, end);
+    {
+        size_t n = 0;
+        for (size_t i=0; i<lines.size(); ++i)
+        {
+            const char* p = skip_blanks(lines[i], end);
+            if (p<end && *p!='\n' && *p!='#')
+                lines[n++] = lines[i];
+        }
+        lines.resize(n);
+    }
+
+
+    // #Vertice, #Faces, #Edges
+    if (lines.empty()) return false;
+    const char* lp = lines[0];
+    if (!(parse_number(lp, end, nV) && parse_number(lp, end, nF)))
+        return false;
+    nE = 0;
+    parse_number(lp, end, nE);
+    if (lines.size() < size_t(1)+nV+nF)
+        return false;
+    mesh.clear();
+    mesh.reserve(nV, std::max(3*nV, nE), nF);
 
 
     // properties
@@ -69,97 +95,95 @@ bool read_off_ascii(Surface_mesh& mesh,
     if (has_colors)    colors    = mesh.vertex_property<Color>("v:color");
 
 
-    // #Vertice, #Faces, #Edges
-    items = fscanf(in, "%d %d %d\n", (int*)&nV, (int*)&nF, (int*)&nE);
-    mesh.clear();
-    mesh.reserve(nV, std::max(3*nV, nE), nF);
-
-
     // read vertices: pos [normal] [color] [texcoord]
-    for (i=0; i<nV && !feof(in); ++i)
+    mesh.add_vertices(nV);
+    Surface_mesh::Vertex_property<Point> points = mesh.vertex_property<Point>("v:point");
+    bool ok = true;
+    #pragma omp parallel for schedule(static) reduction(&&:ok)
+    for (int i=0; i<int(nV); ++i)
     {
-        // read line
-        lp = fgets(line, 200, in);
-        lp = line;
+        Surface_mesh::Vertex v(i);
+        const char* lp = lines[1+i];
+        Vec3 p(0,0,0), n, c;
+        Vec2 t;
 
         // position
-        if(std::is_same<float,Vec3::Scalar>::value)
-          items = sscanf(lp, "%f %f %f%n", &p[0], &p[1], &p[2], &nc);
-        else
-          items = sscanf(lp, "%lf %lf %lf%n", &p[0], &p[1], &p[2], &nc);
-        assert(items==3);
-        v = mesh.add_vertex(make_point(p[0], p[1], p[2]));
-        lp += nc;
+        ok = parse_number(lp, end, p[0]) && parse_number(lp, end, p[1]) && parse_number(lp, end, p[2]) && ok;
+        points[v] = make_point(p);
 
         // normal
         if (has_normals)
         {
-            if(std::is_same<float,Vec3::Scalar>::value)
-              items = sscanf(lp, "%f %f %f%n", &n[0], &n[1], &n[2], &nc);
-            else
-              items = sscanf(lp, "%lf %lf %lf%n", &n[0], &n[1], &n[2], &nc);
-
-            if (items == 3)
-            {
+            if (parse_number(lp, end, n[0]) && parse_number(lp, end, n[1]) && parse_number(lp, end, n[2]))
                 normals[v] = n;
-            }
-            lp += nc;
         }
 
         // color
         if (has_colors)
         {
-            if(std::is_same<float,Vec3::Scalar>::value)
-              items = sscanf(lp, "%f %f %f%n", &c[0], &c[1], &c[2], &nc);
-            else
-              items = sscanf(lp, "%lf %lf %lf%n", &c[0], &c[1], &c[2], &nc);
-            if (items == 3)
+            if (parse_number(lp, end, c[0]) && parse_number(lp, end, c[1]) && parse_number(lp, end, c[2]))
             {
                 if (c[0]>1.0f || c[1]>1.0f || c[2]>1.0f) c *= (1.0/255.0);
                 colors[v] = c;
             }
-            lp += nc;
         }
 
         // tex coord
         if (has_texcoords)
         {
-            if(std::is_same<float,Vec3::Scalar>::value)
-              items = sscanf(lp, "%f %f%n", &t[0], &t[1], &nc);
-            else
-              items = sscanf(lp, "%lf %lf%n", &t[0], &t[1], &nc);
-            assert(items == 2);
+            ok = parse_number(lp, end, t[0]) && parse_number(lp, end, t[1]) && ok;
             texcoords[v][0] = t[0];
             texcoords[v][1] = t[1];
-            lp += nc;
         }
     }
-
+    if (!ok) return false;
 
 
     // read faces: #N v[1] v[2] ... v[n-1]
-    std::vector<Surface_mesh::Vertex> vertices;
-    for (i=0; i<nF; ++i)
+    const int block_size = 1<<15;
+    int nb_blocks = (int(nF) + block_size - 1) / block_size;
+    std::vector< std::vector<int> > blocks(nb_blocks);
+    #pragma omp parallel for schedule(dynamic)
+    for (int b=0; b<nb_blocks; ++b)
     {
-        // read line
-        lp = fgets(line, 200, in);
-        lp = line;
+        int block_end = std::min(int(nF), (b+1)*block_size);
+        for (int i=b*block_size; i<block_end; ++i)
+        {
+            // store the number of parsed indices followed by the indices
+            std::vector<int>& block = blocks[b];
+            const char* lp = lines[1+nV+i];
+            size_t start = block.size();
+            int n, idx;
+            block.push_back(0);
+            if (parse_number(lp, end, n))
+                while (int(block.size()-start-1) < n && parse_number(lp, end, idx))
+                    block.push_back(idx);
+            block[start] = int(block.size()-start-1);
+        }
+    }
 
-        // #vertices
-        items = sscanf(lp, "%d%n", (int*)&nV, &nc);
-        assert(items == 1);
-        vertices.resize(nV);
-        lp += nc;
+    std::vector<int> face_sizes, face_vertices;
+    face_sizes.reserve(nF);
+    for (const std::vector<int>& block : blocks)
+    {
+        for (size_t k=0; k<block.size(); k+=block[k]+1)
+        {
+            face_sizes.push_back(block[k]);
+            face_vertices.insert(face_vertices.end(), block.begin()+k+1, block.begin()+k+1+block[k]);
+        }
+    }
 
-        // indices
-        for (j=0; j<nV; ++j)
+    // non manifold meshes are built face by face
+    if (!mesh.add_faces(face_sizes, face_vertices))
+    {
+        std::vector<Surface_mesh::Vertex> vertices;
+        for (size_t i=0, offset=0; i<face_sizes.size(); offset+=face_sizes[i++])
         {
-            items = sscanf(lp, "%d%n", (int*)&idx, &nc);
-            assert(items == 1);
-            vertices[j] = Surface_mesh::Vertex(idx);
-            lp += nc;
+            vertices.resize(face_sizes[i]);
+            for (int j=0; j<face_sizes[i]; ++j)
+                vertices[j] = Surface_mesh::Vertex(face_vertices[offset+j]);
+            mesh.add_face(vertices);
         }
-        mesh.add_face(vertices);
     }
 
 
@@ -285,21 +309,25 @@ bool read_off(Surface_mesh& mesh, const std::string& filename)
     }
 
 
-    // if binary: reopen file in binary mode
-    if (is_binary)
+    // if ASCII: parse the memory mapped file from the end of the header line
+    if (!is_binary)
     {
+        long offset = ftell(in);
         fclose(in);
-        in = fopen(filename.c_str(), "rb");
-        c = fgets(line, 200, in);
-        assert(c != NULL);
+        Mapped_file file(filename);
+        if (!file.is_open() || offset<0 || size_t(offset)>file.size())
+            return false;
+        return read_off_ascii(mesh, file.begin()+offset, file.end(), has_normals, has_texcoords, has_colors);
     }
 
 
-    // read as ASCII or binary
-    bool ok = (is_binary ?
-               read_off_binary(mesh, in, has_normals, has_texcoords, has_colors) :
-               read_off_ascii(mesh, in, has_normals, has_texcoords, has_colors));
+    // if binary: reopen file in binary mode
+    fclose(in);
+    in = fopen(filename.c_str(), "rb");
+    c = fgets(line, 200, in);
+    assert(c != NULL);
 
+    bool ok = read_off_binary(mesh, in, has_normals, has_texcoords, has_colors);
 
     fclose(in);
     return ok;
@@ -336,51 +364,62 @@ bool write_off(const Surface_mesh& mesh, const std::string& filename)
     fprintf(out, "OFF\n%d %d 0\n", mesh.n_vertices(), mesh.n_faces());
 
 
-    // vertices, and optionally normals and texture coordinates
+    // vertices, and optionally normals and texture coordinates,
+    // the elements are formatted in parallel blocks, see write_text_blocks
     Surface_mesh::Vertex_property<Point> points = mesh.get_vertex_property<Point>("v:point");
-    for (Surface_mesh::Vertex_iterator vit=mesh.vertices_begin(); vit!=mesh.vertices_end(); ++vit)
+    std::vector<Surface_mesh::Vertex> vertices = collect_handles<Surface_mesh::Vertex>(mesh.vertices_begin(), mesh.vertices_end());
+    bool ok = write_text_blocks(out, vertices.size(), [&](int i, Text_buffer& buffer)
     {
-        Vec3 p = make_vec3(points[*vit]);
-        fprintf(out, "%.10f %.10f %.10f", p[0], p[1], p[2]);
+        Surface_mesh::Vertex v = vertices[i];
+        Vec3 p = make_vec3(points[v]);
+        buffer.put(p[0], 10); buffer.put(' ');
+        buffer.put(p[1], 10); buffer.put(' ');
+        buffer.put(p[2], 10);
 
         if (has_normals)
         {
-            const Normal& n = normals[*vit];
-            fprintf(out, " %.10f %.10f %.10f", n[0], n[1], n[2]);
+            const Normal& n = normals[v];
+            buffer.put(' '); buffer.put(n[0], 10);
+            buffer.put(' '); buffer.put(n[1], 10);
+            buffer.put(' '); buffer.put(n[2], 10);
         }
 
         if (has_colors)
         {
-            const Color& c = colors[*vit];
-            fprintf(out, " %.10f %.10f %.10f", c[0], c[1], c[2]);
+            const Color& c = colors[v];
+            buffer.put(' '); buffer.put(c[0], 10);
+            buffer.put(' '); buffer.put(c[1], 10);
+            buffer.put(' '); buffer.put(c[2], 10);
         }
 
         if (has_texcoords)
         {
-            const Texture_coordinate& t = texcoords[*vit];
-            fprintf(out, " %.10f %.10f", t[0], t[1]);
+            const Texture_coordinate& t = texcoords[v];
+            buffer.put(' '); buffer.put(t[0], 10);
+            buffer.put(' '); buffer.put(t[1], 10);
         }
 
-        fprintf(out, "\n");
-    }
+        buffer.put('\n');
+    });
 
 
     // faces
-    for (Surface_mesh::Face_iterator fit=mesh.faces_begin(); fit!=mesh.faces_end(); ++fit)
+    std::vector<Surface_mesh::Face> faces = collect_handles<Surface_mesh::Face>(mesh.faces_begin(), mesh.faces_end());
+    ok = ok && write_text_blocks(out, faces.size(), [&](int i, Text_buffer& buffer)
     {
-        int nV = mesh.valence(*fit);
-        fprintf(out, "%d", nV);
-        Surface_mesh::Vertex_around_face_circulator fvit=mesh.vertices(*fit), fvend=fvit;
+        buffer.put(int(mesh.valence(faces[i])));
+        Surface_mesh::Vertex_around_face_circulator fvit=mesh.vertices(faces[i]), fvend=fvit;
         do
         {
-            fprintf(out, " %d", (*fvit).idx());
+            buffer.put(' ');
+            buffer.put((*fvit).idx());
         }
         while (++fvit != fvend);
-        fprintf(out, "\n");
-    }
+        buffer.put('\n');
+    });
 
     fclose(out);
-    return true;
+    return ok;
 }
 
 
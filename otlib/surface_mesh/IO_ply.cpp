@@ -0,0 +1,96 @@
+//=============================================================================
+// Copyright (C) 2001-2005 by Computer Graphics Group, RWTH Aachen
+// Copyright (C) 2011-2013 by Graphics & Geometry Group, Bielefeld University
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public License
+// as published by the Free Software Foundation, version 2.
+//
+// This library is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//=============================================================================
+
+
+//== INCLUDES =================================================================
+
+
+#include <surface_mesh/IO.h>
+#include <surface_mesh/IO_buffer.h>
+
+#include <cstdio>
+#include <cstdint>
+
+
+//== NAMESPACE ================================================================
+
+
+namespace surface_mesh {
+
+
+//== IMPLEMENTATION ===========================================================
+
+
+// Writes a binary little endian PLY file (the host is assumed to be little endian).
+// Positions are stored as doubles with z=0 for compatibility with 3D viewers.
+bool write_ply(const Surface_mesh& mesh, const std::string& filename)
+{
+    FILE* out = fopen(filename.c_str(), "wb");
+    if (!out)
+        return false;
+
+    // header
+    char header[512];
+    snprintf(header, sizeof(header),
+             "ply\n"
+             "format binary_little_endian 1.0\n"
+             "comment PLY export from Surface_mesh\n"
+             "element vertex %d\n"
+             "property double x\n"
+             "property double y\n"
+             "property double z\n"
+             "element face %d\n"
+             "property list uchar int vertex_indices\n"
+             "end_header\n",
+             mesh.n_vertices(), mesh.n_faces());
+
+    Buffered_writer writer(out);
+    writer.write_string(header);
+
+    // vertices
+    Surface_mesh::Vertex_property<Point> points = mesh.get_vertex_property<Point>("v:point");
+    for (Surface_mesh::Vertex_iterator vit=mesh.vertices_begin(); vit!=mesh.vertices_end(); ++vit)
+    {
+        Vec3 p = make_vec3(points[*vit]);
+        writer.write(p.data(), 3*sizeof(double));
+    }
+
+    // faces
+    int32_t indices[256];
+    for (Surface_mesh::Face_iterator fit=mesh.faces_begin(); fit!=mesh.faces_end(); ++fit)
+    {
+        uint8_t nV = 0;
+        Surface_mesh::Vertex_around_face_circulator fvit=mesh.vertices(*fit), fvend=fvit;
+        do
+        {
+            indices[nV++] = (*fvit).idx();
+        }
+        while (++fvit != fvend && nV<255);
+        writer.write_raw(nV);
+        writer.write(indices, nV*sizeof(int32_t));
+    }
+
+    bool ok = writer.flush();
+    fclose(out);
+    return ok;
+}
+
+
+//=============================================================================
+} // namespace surface_mesh
+//=============================================================================
@@ -23,6 +23,7 @@
 #include <surface_mesh/Surface_mesh.h>
 #include <surface_mesh/IO.h>
 
+#include <algorithm>
 #include <cmath>
 #include <queue>
 
@@ -38,6 +39,7 @@ namespace surface_mesh {
 
 Surface_mesh::
 Surface_mesh()
+    : shared_token_(std::make_shared<char>())
 {
     // allocate standard properties
     // same list is used in operator=() and assign()
@@ -72,24 +74,19 @@ operator=(const Surface_mesh& rhs)
 {
     if (this != &rhs)
     {
-        // deep copy of property containers
+        // shallow copy of property containers, the arrays are detached by unshare()
+        // before being modified. the positions are copied right away since most
+        // copies are made to be deformed.
         vprops_ = rhs.vprops_;
         hprops_ = rhs.hprops_;
         eprops_ = rhs.eprops_;
         fprops_ = rhs.fprops_;
+        vprops_.detach("v:point");
+        shared_token_ = rhs.shared_token_;
+        face_vertex_indices_ = std::atomic_load(&rhs.face_vertex_indices_);
 
         // property handles contain pointers, have to be reassigned
-        vconn_    = vertex_property<Vertex_connectivity>("v:connectivity");
-        hconn_    = halfedge_property<Halfedge_connectivity>("h:connectivity");
-        fconn_    = face_property<Face_connectivity>("f:connectivity");
-        vdeleted_ = vertex_property<bool>("v:deleted");
-        edeleted_ = edge_property<bool>("e:deleted");
-        fdeleted_ = face_property<bool>("f:deleted");
-        vpoint_   = vertex_property<Point>("v:point");
-
-        // normals might be there, therefore use get_property
-        vnormal_  = get_vertex_property<Normal>("v:normal");
-        fnormal_  = get_face_property<Normal>("f:normal");
+        update_property_handles();
 
         // how many elements are deleted?
         deleted_vertices_ = rhs.deleted_vertices_;
@@ -116,6 +113,8 @@ assign(const Surface_mesh& rhs)
         hprops_.clear();
         eprops_.clear();
         fprops_.clear();
+        shared_token_ = std::make_shared<char>();
+        invalidate_face_vertex_indices();
 
         // allocate standard properties
         vconn_    = add_vertex_property<Vertex_connectivity>("v:connectivity");
@@ -159,6 +158,91 @@ assign(const Surface_mesh& rhs)
 //-----------------------------------------------------------------------------
 
 
+void
+Surface_mesh::
+update_property_handles()
+{
+    // fetch through a const reference, the arrays must stay shared
+    const Surface_mesh& self = *this;
+    vconn_    = self.get_vertex_property<Vertex_connectivity>("v:connectivity");
+    hconn_    = self.get_halfedge_property<Halfedge_connectivity>("h:connectivity");
+    fconn_    = self.get_face_property<Face_connectivity>("f:connectivity");
+    vdeleted_ = self.get_vertex_property<bool>("v:deleted");
+    edeleted_ = self.get_edge_property<bool>("e:deleted");
+    fdeleted_ = self.get_face_property<bool>("f:deleted");
+    vpoint_   = self.get_vertex_property<Point>("v:point");
+
+    // normals might be there, therefore use get_property
+    vnormal_  = self.get_vertex_property<Normal>("v:normal");
+    fnormal_  = self.get_face_property<Normal>("f:normal");
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+void
+Surface_mesh::
+unshare_properties(bool keep_data)
+{
+    vprops_.detach(keep_data);
+    hprops_.detach(keep_data);
+    eprops_.detach(keep_data);
+    fprops_.detach(keep_data);
+    update_property_handles();
+    shared_token_ = std::make_shared<char>();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+const std::vector<Eigen::Array4i>&
+Surface_mesh::
+face_vertex_indices() const
+{
+    std::shared_ptr<const std::vector<Eigen::Array4i> > indices = std::atomic_load(&face_vertex_indices_);
+    if (indices)
+        return *indices;
+
+    int nf = faces_size();
+    std::shared_ptr<std::vector<Eigen::Array4i> > new_indices =
+        std::make_shared< std::vector<Eigen::Array4i> >(nf, Eigen::Array4i::Constant(-1));
+    std::vector<Eigen::Array4i>& fv = *new_indices;
+
+    #pragma omp parallel for
+    for (int i=0; i<nf; ++i)
+    {
+        Face f(i);
+        if (is_deleted(f))
+            continue;
+        Eigen::Array4i ids(-1,-1,-1,-1);
+        int j = 0;
+        Halfedge h = halfedge(f), hend = h;
+        do
+        {
+            if (j<4)
+                ids(j) = to_vertex(h).idx();
+            ++j;
+            h = next_halfedge(h);
+        }
+        while (h != hend);
+        if (j==3 || j==4)
+            fv[i] = ids;
+    }
+
+    // keep the first cache stored by concurrent callers, its reference might already be in use
+    indices = new_indices;
+    std::shared_ptr<const std::vector<Eigen::Array4i> > expected;
+    if (!std::atomic_compare_exchange_strong(&face_vertex_indices_, &expected, indices))
+        indices = expected;
+    return *indices;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
 bool
 Surface_mesh::
 read(const std::string& filename)
@@ -185,6 +269,12 @@ void
 Surface_mesh::
 clear()
 {
+    // no need to copy the shared arrays
+    if (shared_token_.use_count() > 1)
+        unshare_properties(false);
+
+    invalidate_face_vertex_indices();
+
     vprops_.resize(0);
     hprops_.resize(0);
     eprops_.resize(0);
@@ -207,6 +297,7 @@ void
 Surface_mesh::
 free_memory()
 {
+    unshare();
     vprops_.free_memory();
     hprops_.free_memory();
     eprops_.free_memory();
@@ -223,6 +314,7 @@ reserve(unsigned int nvertices,
         unsigned int nedges,
         unsigned int nfaces )
 {
+    unshare();
     vprops_.reserve(nvertices);
     hprops_.reserve(2*nedges);
     eprops_.reserve(nedges);
@@ -364,10 +456,288 @@ add_quad(Vertex v0, Vertex v1, Vertex v2, Vertex v3)
 //-----------------------------------------------------------------------------
 
 
+void
+Surface_mesh::
+build_quad_grid(unsigned int rows, unsigned int cols)
+{
+    assert(rows>=2 && cols>=2);
+
+    clear();
+
+    // number of quads along j and i
+    const int M = rows-1;
+    const int N = cols-1;
+
+    // add_quad creates the missing edges of each quad in the order of its halfedges,
+    // that is v0v1 (if j==0), v1v2, v2v3, and v3v0 (if i==0). these are the indices
+    // of the edges of the quad (i,j) in this creation order.
+    auto e0 = [&](int i, int j) { return i*(2*M+1) + (i>0 ? M : 0) + 2*j + (j>0 ? 1 : 0) + (i==0 ? j : 0); };
+    auto e1 = [&](int i, int j) { return e0(i,j) + (j==0 ? 1 : 0); };
+    auto e2 = [&](int i, int j) { return e1(i,j) + 1; };
+    auto e3 = [&](int i, int j) { return e2(i,j) + 1; };
+    auto vertex = [&](int i, int j) { return Vertex(j+i*rows); };
+
+    // the halfedges of the quad (i,j), a new edge from v to w has the halfedges 2*e (v->w) and 2*e+1
+    auto quad_halfedges = [&](int i, int j, Halfedge* h) {
+        h[0] = Halfedge(j==0 ? 2*e0(i,j) : 2*e2(i,j-1)+1);
+        h[1] = Halfedge(2*e1(i,j));
+        h[2] = Halfedge(2*e2(i,j));
+        h[3] = Halfedge(i==0 ? 2*e3(i,j) : 2*e1(i-1,j)+1);
+    };
+
+    // outgoing boundary halfedge of the boundary vertex (i,j), the boundary is traversed clockwise
+    auto boundary_halfedge = [&](int i, int j) {
+        if (i==0 && j<M)  return Halfedge(2*e3(0,j)+1);
+        if (j==M && i<N)  return Halfedge(2*e2(i,M-1)+1);
+        if (i==N && j>0)  return Halfedge(2*e1(N-1,j-1)+1);
+        return Halfedge(2*e0(i-1,0)+1);
+    };
+
+    const int nE = N*(M+1) + (N+1)*M;
+    vprops_.resize(rows*cols);
+    hprops_.resize(2*nE);
+    eprops_.resize(nE);
+    fprops_.resize(M*N);
+
+    // each quad sets its inner halfedges and the target vertices of the edges it creates
+    #pragma omp parallel for
+    for (int i=0; i<N; ++i)
+    {
+        for (int j=0; j<M; ++j)
+        {
+            Face f(j+i*M);
+            Vertex v[4] = { vertex(i,j), vertex(i+1,j), vertex(i+1,j+1), vertex(i,j+1) };
+            Halfedge h[4];
+            quad_halfedges(i, j, h);
+
+            for (int k=0; k<4; ++k)
+            {
+                Halfedge_connectivity& hc = hconn_[h[k]];
+                hc.vertex_        = v[(k+1)%4];
+                hc.face_          = f;
+                hc.next_halfedge_ = h[(k+1)%4];
+                hc.prev_halfedge_ = h[(k+3)%4];
+                if (h[k].idx()%2 == 0)
+                    hconn_[opposite_halfedge(h[k])].vertex_ = v[k];
+            }
+            fconn_[f].halfedge_ = h[3];
+
+            // outgoing halfedge of the interior vertices
+            if (i>0 && j>0)
+                vconn_[v[0]].halfedge_ = h[0];
+        }
+    }
+
+    // boundary loop
+    std::vector< std::pair<int,int> > boundary;
+    for (int j=0; j<M; ++j) boundary.push_back(std::make_pair(0,j));
+    for (int i=0; i<N; ++i) boundary.push_back(std::make_pair(i,M));
+    for (int j=M; j>0; --j) boundary.push_back(std::make_pair(N,j));
+    for (int i=N; i>0; --i) boundary.push_back(std::make_pair(i,0));
+    for (std::size_t k=0; k<boundary.size(); ++k)
+    {
+        const std::pair<int,int>& a = boundary[k];
+        const std::pair<int,int>& b = boundary[(k+1)%boundary.size()];
+        Halfedge h  = boundary_halfedge(a.first, a.second);
+        Halfedge nh = boundary_halfedge(b.first, b.second);
+        vconn_[vertex(a.first, a.second)].halfedge_ = h;
+        hconn_[h].next_halfedge_  = nh;
+        hconn_[nh].prev_halfedge_ = h;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+bool
+Surface_mesh::
+add_faces(const std::vector<int>& face_sizes, const std::vector<int>& face_vertices)
+{
+    if (faces_size() > 0 || edges_size() > 0)
+        return false;
+
+    const int nV(vertices_size()), nF(face_sizes.size());
+
+    // the corner c of a face goes from the vertex face_vertices[c] to the next vertex of the face
+    std::vector<int> offsets(nF+1, 0);
+    for (int f=0; f<nF; ++f)
+    {
+        if (face_sizes[f] < 3)
+            return false;
+        offsets[f+1] = offsets[f] + face_sizes[f];
+    }
+    if (offsets[nF] != int(face_vertices.size()))
+        return false;
+    const int nC = offsets[nF];
+
+    std::vector<int> next_corner(nC), prev_corner(nC);
+    bool ok = true;
+    #pragma omp parallel for reduction(&&:ok)
+    for (int f=0; f<nF; ++f)
+    {
+        const int c0 = offsets[f], n = face_sizes[f];
+        for (int k=0; k<n; ++k)
+        {
+            const int v = face_vertices[c0+k];
+            next_corner[c0+k] = c0 + (k+1)%n;
+            prev_corner[c0+k] = c0 + (k+n-1)%n;
+            ok = v>=0 && v<nV && ok;
+            for (int l=0; l<k; ++l)
+                ok = face_vertices[c0+l]!=v && ok;
+        }
+    }
+    if (!ok)
+        return false;
+
+    auto from = [&](int c) { return face_vertices[c]; };
+    auto to   = [&](int c) { return face_vertices[next_corner[c]]; };
+
+    // pair the corners sharing an edge: the corners are bucketed per smallest end vertex,
+    // and sorted per largest end vertex within each bucket
+    std::vector<int> bucket_start(nV+1, 0), buckets(nC);
+    for (int c=0; c<nC; ++c)
+        ++bucket_start[std::min(from(c), to(c))+1];
+    for (int v=0; v<nV; ++v)
+        bucket_start[v+1] += bucket_start[v];
+    {
+        std::vector<int> pos(bucket_start.begin(), bucket_start.end()-1);
+        for (int c=0; c<nC; ++c)
+            buckets[pos[std::min(from(c), to(c))]++] = c;
+    }
+
+    std::vector<int> partner(nC, -1);
+    #pragma omp parallel for schedule(dynamic,1024) reduction(&&:ok)
+    for (int v=0; v<nV; ++v)
+    {
+        auto other_end = [&](int c) { return std::max(from(c), to(c)); };
+        int* begin = buckets.data() + bucket_start[v];
+        int* end   = buckets.data() + bucket_start[v+1];
+        std::sort(begin, end, [&](int a, int b) { return other_end(a) < other_end(b) || (other_end(a) == other_end(b) && a < b); });
+        for (int* it=begin; it<end; )
+        {
+            int* run_end = it+1;
+            while (run_end<end && other_end(*run_end)==other_end(*it))
+                ++run_end;
+            // an edge is shared by at most two faces, in opposite directions
+            if (run_end-it == 2 && from(it[0]) == to(it[1]))
+            {
+                partner[it[0]] = it[1];
+                partner[it[1]] = it[0];
+            }
+            else if (run_end-it > 1)
+                ok = false;
+            it = run_end;
+        }
+    }
+    if (!ok)
+        return false;
+
+    // the edges are numbered in the order of their first corner, as add_face() creates them,
+    // and their first halfedge goes along this corner
+    std::vector<Halfedge> corner_halfedges(nC);
+    int nE = 0;
+    for (int c=0; c<nC; ++c)
+        if (partner[c] < 0 || c < partner[c])
+            corner_halfedges[c] = Halfedge(2*nE++);
+    for (int c=0; c<nC; ++c)
+        if (partner[c] >= 0 && partner[c] < c)
+            corner_halfedges[c] = opposite_halfedge(corner_halfedges[partner[c]]);
+
+    // the boundary halfedges starting and ending at each vertex, at most one per vertex
+    std::vector<Halfedge> boundary_out(nV), boundary_in(nV);
+    std::vector<int> valence(nV, 0);
+    for (int c=0; c<nC; ++c)
+    {
+        ++valence[from(c)];
+        if (partner[c] < 0)
+        {
+            if (boundary_out[to(c)].is_valid() || boundary_in[from(c)].is_valid())
+                return false;
+            boundary_out[to(c)]  = opposite_halfedge(corner_halfedges[c]);
+            boundary_in[from(c)] = opposite_halfedge(corner_halfedges[c]);
+            ++valence[to(c)];
+        }
+    }
+
+    unshare();
+    invalidate_face_vertex_indices();
+    hprops_.resize(2*nE);
+    eprops_.resize(nE);
+    fprops_.resize(nF);
+
+    // each face sets its inner halfedges and the opposite boundary halfedges
+    #pragma omp parallel for
+    for (int f=0; f<nF; ++f)
+    {
+        for (int c=offsets[f]; c<offsets[f+1]; ++c)
+        {
+            Halfedge_connectivity& hc = hconn_[corner_halfedges[c]];
+            hc.vertex_        = Vertex(to(c));
+            hc.face_          = Face(f);
+            hc.next_halfedge_ = corner_halfedges[next_corner[c]];
+            hc.prev_halfedge_ = corner_halfedges[prev_corner[c]];
+            if (partner[c] < 0)
+            {
+                Halfedge_connectivity& bc = hconn_[opposite_halfedge(corner_halfedges[c])];
+                bc.vertex_        = Vertex(from(c));
+                bc.face_          = Face();
+                bc.next_halfedge_ = boundary_out[from(c)];
+                bc.prev_halfedge_ = boundary_in[to(c)];
+            }
+        }
+        fconn_[Face(f)].halfedge_ = corner_halfedges[offsets[f+1]-1];
+    }
+
+    // outgoing halfedges, the boundary one for boundary vertices
+    for (int c=nC-1; c>=0; --c)
+        vconn_[Vertex(from(c))].halfedge_ = corner_halfedges[c];
+
+    // the faces around each vertex must form a single fan
+    #pragma omp parallel for reduction(&&:ok)
+    for (int v=0; v<nV; ++v)
+    {
+        if (boundary_out[v].is_valid())
+            vconn_[Vertex(v)].halfedge_ = boundary_out[v];
+        Halfedge h0 = vconn_[Vertex(v)].halfedge_;
+        if (!h0.is_valid())
+            continue;
+        int count = 0;
+        Halfedge h = h0;
+        do
+        {
+            h = cw_rotated_halfedge(h);
+            ++count;
+        }
+        while (h != h0 && count <= valence[v]);
+        ok = count == valence[v] && ok;
+    }
+
+    if (!ok)
+    {
+        // back to the isolated vertices
+        hprops_.resize(0);
+        eprops_.resize(0);
+        fprops_.resize(0);
+        #pragma omp parallel for
+        for (int v=0; v<nV; ++v)
+            vconn_[Vertex(v)].halfedge_ = Halfedge();
+        return false;
+    }
+
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+
+
 Surface_mesh::Face
 Surface_mesh::
 add_face(const std::vector<Vertex>& vertices)
 {
+    unshare();
+
     const unsigned int n(vertices.size());
     assert (n > 2);
 
@@ -858,6 +1228,8 @@ void
 Surface_mesh::
 triangulate()
 {
+    unshare();
+
     /* The iterators will stay valid, even though new faces are added,
      because they are now implemented index-based instead of
      pointer-based.
@@ -873,6 +1245,8 @@ std::vector<Surface_mesh::Face>
 Surface_mesh::
 triangulate(Face f)
 {
+    unshare();
+
     /*
      Split an arbitrary face into triangles by connecting
      each vertex of fh after its second to vh.
@@ -935,6 +1309,7 @@ void
 Surface_mesh::
 update_face_normals()
 {  
+    unshare();
   if (!fnormal_)
     fnormal_ = face_property<Normal>("f:normal");
 
@@ -993,6 +1368,8 @@ void
 Surface_mesh::
 update_vertex_normals()
 {
+    unshare();
+
     if (!vnormal_)
         vnormal_ = vertex_property<Normal>("v:normal");
 
@@ -1081,6 +1458,8 @@ void
 Surface_mesh::
 split(Face f, Vertex v)
 {
+    unshare();
+
     /*
      Split an arbitrary face into triangles by connecting each vertex of fh to vh.
      - fh will remain valid (it will become one of the triangles)
@@ -1135,6 +1514,8 @@ void
 Surface_mesh::
 split(Edge e, Vertex v)
 {
+    unshare();
+
     Halfedge h0 = halfedge(e, 0);
     Halfedge o0 = halfedge(e, 1);
 
@@ -1236,6 +1617,8 @@ Surface_mesh::Halfedge
 Surface_mesh::
 insert_vertex(Halfedge h0, Vertex v)
 {
+    unshare();
+
     // before:
     //
     // v0      h0       v2
@@ -1293,6 +1676,8 @@ Surface_mesh::Halfedge
 Surface_mesh::
 insert_edge(Halfedge h0, Halfedge h1)
 {
+    unshare();
+
     assert(face(h0) == face(h1));
     assert(face(h0).is_valid());
 
@@ -1364,6 +1749,8 @@ void
 Surface_mesh::
 flip(Edge e)
 {
+    unshare();
+
     // CAUTION : Flipping a halfedge may result in
     // a non-manifold mesh, hence check for yourself
     // whether this operation is allowed or not!
@@ -1484,6 +1871,8 @@ void
 Surface_mesh::
 collapse(Halfedge h)
 {
+    unshare();
+
     Halfedge h0 = h;
     Halfedge h1 = prev_halfedge(h0);
     Halfedge o0 = opposite_halfedge(h0);
@@ -1507,6 +1896,8 @@ Surface_mesh::reversed_info
 Surface_mesh::
 collapse_with_reversed_info(Halfedge h)
 {
+    unshare();
+
     Halfedge o = opposite_halfedge(h);
     Vertex vh = to_vertex(h);
     Vertex vo = to_vertex(o);
@@ -1590,6 +1981,9 @@ void
 Surface_mesh::
 reverse_collapse(reversed_info ri)
 {
+    unshare();
+    invalidate_face_vertex_indices();
+
     //restore vertex
     std::list<std::pair<Vertex,Vertex_connectivity> >::iterator vit;
     for(vit=ri.v.begin(); vit != ri.v.end(); ++vit) {
@@ -1735,6 +2129,9 @@ void
 Surface_mesh::
 delete_vertex(Vertex v)
 {
+    unshare();
+    invalidate_face_vertex_indices();
+
     if (vdeleted_[v])  return;
 
     // collect incident faces
@@ -1770,6 +2167,9 @@ void
 Surface_mesh::
 delete_edge(Edge e)
 {
+    unshare();
+    invalidate_face_vertex_indices();
+
     if (edeleted_[e])  return;
 
     Face f0 = face(halfedge(e, 0));
@@ -1786,6 +2186,9 @@ void
 Surface_mesh::
 delete_face(Face f)
 {
+    unshare();
+    invalidate_face_vertex_indices();
+
     if (fdeleted_[f])  return;
 
     // mark face deleted
@@ -1972,138 +2375,218 @@ void Surface_mesh::diffuse_normals(float sigma)
 
 void
 Surface_mesh::
-garbage_collection()
+delete_faces(const std::vector<bool>& mask)
 {
-    int  i, i0, i1,
-    nV(vertices_size()),
-    nE(edges_size()),
-    nH(halfedges_size()),
-    nF(faces_size());
+    unshare();
+    invalidate_face_vertex_indices();
 
-    Vertex    v;
-    Halfedge  h;
-    Face      f;
+    int nV(vertices_size()), nE(edges_size()), nH(halfedges_size()), nF(faces_size());
+    assert(int(mask.size()) == nF);
 
+    // mark faces deleted, and their vertices for updating their outgoing halfedge
+    std::vector<char> vertex_state(nV, 0);
+    for (int i=0; i<nF; ++i)
+    {
+        Face f(i);
+        if (mask[i] && !fdeleted_[f])
+        {
+            fdeleted_[f] = true;
+            deleted_faces_++;
 
-    // setup handle mapping
-    Vertex_property<Vertex>      vmap = add_vertex_property<Vertex>("v:garbage-collection");
-    Halfedge_property<Halfedge>  hmap = add_halfedge_property<Halfedge>("h:garbage-collection");
-    Face_property<Face>          fmap = add_face_property<Face>("f:garbage-collection");
-    for (i=0; i<nV; ++i)
-        vmap[Vertex(i)] = Vertex(i);
-    for (i=0; i<nH; ++i)
-        hmap[Halfedge(i)] = Halfedge(i);
-    for (i=0; i<nF; ++i)
-        fmap[Face(i)] = Face(i);
+            Halfedge_around_face_circulator hc, hc_end;
+            hc = hc_end = halfedges(f);
+            do vertex_state[to_vertex(*hc).idx()] = 1;
+            while (++hc != hc_end);
+        }
+    }
 
+    // an edge is deleted when none of its halfedges has a face anymore,
+    // edge_state is 1 for these edges, and 2 for the already deleted ones
+    std::vector<char> edge_state(nE, 0);
+    #pragma omp parallel for
+    for (int i=0; i<nE; ++i)
+    {
+        Edge e(i);
+        Face f0 = face(halfedge(e,0)), f1 = face(halfedge(e,1));
+        if (edeleted_[e])
+            edge_state[i] = 2;
+        else if ((!f0.is_valid() || fdeleted_[f0]) && (!f1.is_valid() || fdeleted_[f1]))
+            edge_state[i] = 1;
+    }
 
+    // invalidate the face of the remaining halfedges of deleted faces, and skip the deleted
+    // halfedges in the next handles. This is what delete_face does by linking prev(h0) to
+    // next(h1), and as only the remaining halfedges are modified, the walks through the
+    // deleted ones see the original connectivity.
+    #pragma omp parallel for
+    for (int i=0; i<nH; ++i)
+    {
+        Halfedge h(i);
+        if (edge_state[i/2] != 0) continue;
+
+        Halfedge_connectivity& hc = hconn_[h];
+        if (hc.face_.is_valid() && !fdeleted_[hc.face_]) continue;
+        hc.face_ = Face();
+
+        Halfedge next = hc.next_halfedge_;
+        while (edge_state[next.idx()/2] == 1)
+            next = next_halfedge(opposite_halfedge(next));
+        hc.next_halfedge_ = next;
+        hconn_[next].prev_halfedge_ = h;
+    }
 
-    // remove deleted vertices
-    if (nV > 0)
+    // vertices losing all their edges are deleted (vertex_state 2), the outgoing halfedge of
+    // the other ones must be a remaining halfedge, and a boundary one for boundary vertices
+    #pragma omp parallel for
+    for (int i=0; i<nV; ++i)
     {
-        i0=0;  i1=nV-1;
+        if (vertex_state[i] == 0) continue;
 
-        while (1)
+        Vertex v(i);
+        Halfedge h = halfedge(v);
+        if (edge_state[h.idx()/2] == 1)
         {
-            // find first deleted and last un-deleted
-            while (!vdeleted_[Vertex(i0)] && i0 < i1)  ++i0;
-            while ( vdeleted_[Vertex(i1)] && i0 < i1)  --i1;
-            if (i0 >= i1) break;
-
-            // swap
-            vprops_.swap(i0, i1);
-        };
+            // rotate through the original connectivity around v
+            Halfedge h0 = h;
+            do h = next_halfedge(opposite_halfedge(h));
+            while (edge_state[h.idx()/2] == 1 && h != h0);
+            if (h == h0)
+            {
+                vertex_state[i] = 2;
+                continue;
+            }
+        }
 
-        // remember new size
-        nV = vdeleted_[Vertex(i0)] ? i0 : i0+1;
+        Halfedge h0 = h;
+        while (!is_boundary(h))
+        {
+            h = cw_rotated_halfedge(h);
+            if (h == h0) break;
+        }
+        vconn_[v].halfedge_ = h;
     }
 
-
-    // remove deleted edges
-    if (nE > 0)
+    // mark edges and vertices deleted
+    for (int i=0; i<nE; ++i)
     {
-        i0=0;  i1=nE-1;
-
-        while (1)
+        if (edge_state[i] == 1)
+        {
+            edeleted_[Edge(i)] = true;
+            deleted_edges_++;
+        }
+    }
+    for (int i=0; i<nV; ++i)
+    {
+        if (vertex_state[i] == 2)
         {
-            // find first deleted and last un-deleted
-            while (!edeleted_[Edge(i0)] && i0 < i1)  ++i0;
-            while ( edeleted_[Edge(i1)] && i0 < i1)  --i1;
-            if (i0 >= i1) break;
-
-            // swap
-            eprops_.swap(i0, i1);
-            hprops_.swap(2*i0,   2*i1);
-            hprops_.swap(2*i0+1, 2*i1+1);
-        };
-
-        // remember new size
-        nE = edeleted_[Edge(i0)] ? i0 : i0+1;
-        nH = 2*nE;
+            vdeleted_[Vertex(i)] = true;
+            deleted_vertices_++;
+        }
     }
 
+    garbage_ = true;
+    garbage_collection();
+}
+
+
+//-----------------------------------------------------------------------------
+
+
+// Computes the new index of the elements that are not deleted, -1 for the deleted ones,
+// and returns the new number of elements. The order is the one of an in-place compaction
+// swapping the first deleted element with the last valid one: the valid elements among the
+// n_valid first ones are kept in place, the others fill the holes in reverse order.
+// Thus the moved elements never overwrite the kept or moved ones.
+static int compaction_map(const std::vector<bool>& deleted, std::vector<int>& map)
+{
+    int n = int(deleted.size());
+    map.assign(n, -1);
+
+    int n_valid = 0;
+    for (int i=0; i<n; ++i)
+        if (!deleted[i]) ++n_valid;
 
-    // remove deleted faces
-    if (nF > 0)
+    std::vector<int> holes;
+    holes.reserve(n-n_valid);
+    for (int i=0; i<n_valid; ++i)
     {
-        i0=0;  i1=nF-1;
+        if (deleted[i]) holes.push_back(i);
+        else            map[i] = i;
+    }
+
+    int k = 0;
+    for (int i=n-1; i>=n_valid; --i)
+        if (!deleted[i]) map[i] = holes[k++];
+
+    return n_valid;
+}
+
+
+//-----------------------------------------------------------------------------
 
-        while (1)
-        {
-            // find 1st deleted and last un-deleted
-            while (!fdeleted_[Face(i0)] && i0 < i1)  ++i0;
-            while ( fdeleted_[Face(i1)] && i0 < i1)  --i1;
-            if (i0 >= i1) break;
 
-            // swap
-            fprops_.swap(i0, i1);
-        };
+void
+Surface_mesh::
+garbage_collection()
+{
+    unshare();
+    invalidate_face_vertex_indices();
 
-        // remember new size
-        nF = fdeleted_[Face(i0)] ? i0 : i0+1;
+    // setup handle mapping
+    std::vector<int> vmap, emap, hmap, fmap;
+    int nV = compaction_map(vdeleted_.vector(), vmap);
+    int nE = compaction_map(edeleted_.vector(), emap);
+    int nF = compaction_map(fdeleted_.vector(), fmap);
+    int nH = 2*nE;
+
+    int ne = int(emap.size());
+    hmap.resize(2*ne);
+    #pragma omp parallel for
+    for (int i=0; i<ne; ++i)
+    {
+        hmap[2*i]   = emap[i]<0 ? -1 : 2*emap[i];
+        hmap[2*i+1] = emap[i]<0 ? -1 : 2*emap[i]+1;
     }
 
 
+    // move the remaining elements and resize the arrays
+    vprops_.compact(vmap, nV); vprops_.free_memory();
+    hprops_.compact(hmap, nH); hprops_.free_memory();
+    eprops_.compact(emap, nE); eprops_.free_memory();
+    fprops_.compact(fmap, nF); fprops_.free_memory();
+
+
     // update vertex connectivity
-    for (i=0; i<nV; ++i)
+    #pragma omp parallel for
+    for (int i=0; i<nV; ++i)
     {
-        v = Vertex(i);
-        if (!is_isolated(v))
-            set_halfedge(v, hmap[halfedge(v)]);
+        Vertex_connectivity& vc = vconn_[Vertex(i)];
+        if (vc.halfedge_.is_valid())
+            vc.halfedge_ = Halfedge(hmap[vc.halfedge_.idx()]);
     }
 
 
     // update halfedge connectivity
-    for (i=0; i<nH; ++i)
+    #pragma omp parallel for
+    for (int i=0; i<nH; ++i)
     {
-        h = Halfedge(i);
-        set_vertex(h, vmap[to_vertex(h)]);
-        set_next_halfedge(h, hmap[next_halfedge(h)]);
-        if (!is_boundary(h))
-            set_face(h, fmap[face(h)]);
+        Halfedge_connectivity& hc = hconn_[Halfedge(i)];
+        hc.vertex_        = Vertex(vmap[hc.vertex_.idx()]);
+        hc.next_halfedge_ = Halfedge(hmap[hc.next_halfedge_.idx()]);
+        hc.prev_halfedge_ = Halfedge(hmap[hc.prev_halfedge_.idx()]);
+        if (hc.face_.is_valid())
+            hc.face_ = Face(fmap[hc.face_.idx()]);
     }
 
 
     // update handles of faces
-    for (i=0; i<nF; ++i)
+    #pragma omp parallel for
+    for (int i=0; i<nF; ++i)
     {
-        f = Face(i);
-        set_halfedge(f, hmap[halfedge(f)]);
+        Face_connectivity& fc = fconn_[Face(i)];
+        fc.halfedge_ = Halfedge(hmap[fc.halfedge_.idx()]);
     }
 
-
-    // remove handle maps
-    remove_vertex_property(vmap);
-    remove_halfedge_property(hmap);
-    remove_face_property(fmap);
-
-
-    // finally resize arrays
-    vprops_.resize(nV); vprops_.free_memory();
-    hprops_.resize(nH); hprops_.free_memory();
-    eprops_.resize(nE); eprops_.free_memory();
-    fprops_.resize(nF); fprops_.free_memory();
-
     deleted_vertices_ = deleted_edges_ = deleted_faces_ = 0;
     garbage_ = false;
 }
@@ -29,6 +29,7 @@
 #include <surface_mesh/properties.h>
 
 #include <list>
+#include <memory>
 #include <vector>
 
 
@@ -898,10 +899,15 @@ public: //-------------------------------------------- constructor / destructor
     // destructor (is virtual, since we inherit from Geometry_representation)
     virtual ~Surface_mesh();
 
-    /// copy constructor: copies \c rhs to \c *this. performs a deep copy of all properties.
+    /// copy constructor: copies \c rhs to \c *this. see operator=().
     Surface_mesh(const Surface_mesh& rhs) { operator=(rhs); }
 
-    /// assign \c rhs to \c *this. performs a deep copy of all properties.
+    /// assign \c rhs to \c *this. only the vertex positions are copied right away,
+    /// the connectivity and the other properties are shared with \c rhs until one
+    /// of the two meshes is modified or a property is fetched from a non-const mesh
+    /// (copy-on-write). property handles obtained before the copy, or from a const
+    /// mesh, refer to the shared arrays: they must only be read, or be fetched again
+    /// from the non-const mesh before writing to them.
     Surface_mesh& operator=(const Surface_mesh& rhs);
 
     /// assign \c rhs to \c *this. does not copy custom properties.
@@ -943,10 +949,27 @@ public: //----------------------------------------------- add new vertex / face
         return v;
     }
 
+    /// add \c n new vertices, their positions are left to the caller
+    /// \sa add_vertex
+    void add_vertices(unsigned int n)
+    {
+        unshare();
+        vprops_.resize(vertices_size()+n);
+    }
+
     /// add a new face with vertex list \c vertices
     /// \sa add_triangle, add_quad
     Face add_face(const std::vector<Vertex>& vertices);
 
+    /// add the faces given by their number of vertices \c face_sizes and their concatenated
+    /// vertex indices \c face_vertices to a mesh that has no face yet. this is the same mesh as
+    /// the one obtained by adding the faces in this order with add_face(), except for the
+    /// outgoing halfedges of the interior vertices, but the connectivity is directly set in
+    /// parallel. returns false and leaves the mesh unchanged if the faces do not form a
+    /// manifold mesh, in which case they have to be added one by one with add_face().
+    /// \sa add_face
+    bool add_faces(const std::vector<int>& face_sizes, const std::vector<int>& face_vertices);
+
     /// add a new triangle connecting vertices \c v1, \c v2, \c v3
     /// \sa add_face, add_quad
     Face add_triangle(Vertex v1, Vertex v2, Vertex v3);
@@ -955,6 +978,14 @@ public: //----------------------------------------------- add new vertex / face
     /// \sa add_triangle, add_face
     Face add_quad(Vertex v1, Vertex v2, Vertex v3, Vertex v4);
 
+    /// replace the mesh by the quads of a grid of \c rows x \c cols vertices.
+    /// the vertex (i,j) has index j+i*rows, and the quad (i,j) has index j+i*(rows-1)
+    /// and vertices (i,j), (i+1,j), (i+1,j+1), (i,j+1). this is the same mesh as the one
+    /// obtained by adding the quads in this order with add_quad(), but the connectivity
+    /// is directly set in parallel. the vertex positions are left to the caller.
+    /// \sa add_quad
+    void build_quad_grid(unsigned int rows, unsigned int cols);
+
     //@}
 
 
@@ -1072,6 +1103,7 @@ public: //---------------------------------------------- low-level connectivity
     /// set the outgoing halfedge of vertex \c v to \c h
     void set_halfedge(Vertex v, Halfedge h)
     {
+        unshare();
         vconn_[v].halfedge_ = h;
     }
 
@@ -1119,6 +1151,8 @@ public: //---------------------------------------------- low-level connectivity
     /// sets the vertex the halfedge \c h points to to \c v
     void set_vertex(Halfedge h, Vertex v)
     {
+        unshare();
+        invalidate_face_vertex_indices();
         hconn_[h].vertex_ = v;
     }
 
@@ -1131,6 +1165,7 @@ public: //---------------------------------------------- low-level connectivity
     /// sets the incident face to halfedge \c h to \c f
     void set_face(Halfedge h, Face f)
     {
+        unshare();
         hconn_[h].face_ = f;
     }
 
@@ -1143,6 +1178,8 @@ public: //---------------------------------------------- low-level connectivity
     /// sets the next halfedge of \c h within the face to \c nh
     void set_next_halfedge(Halfedge h, Halfedge nh)
     {
+        unshare();
+        invalidate_face_vertex_indices();
         hconn_[h].next_halfedge_ = nh;
         hconn_[nh].prev_halfedge_ = h;
     }
@@ -1223,6 +1260,8 @@ public: //---------------------------------------------- low-level connectivity
     /// sets the halfedge of face \c f to \c h
     void set_halfedge(Face f, Halfedge h)
     {
+        unshare();
+        invalidate_face_vertex_indices();
         fconn_[f].halfedge_ = h;
     }
 
@@ -1241,6 +1280,13 @@ public: //---------------------------------------------- low-level connectivity
         return false;
     }
 
+    /// returns the indices of the vertices of each face, indexed by face index, in the
+    /// order of the Vertex_around_face_circulator. the 4th index is -1 for triangles, and
+    /// all indices are -1 for deleted faces and faces with more than 4 vertices.
+    /// the array is built on first use and kept until the connectivity is modified.
+    /// this function is thread-safe as long as the mesh is not modified.
+    const std::vector<Eigen::Array4i>& face_vertex_indices() const;
+
     //@}
 
 
@@ -1256,6 +1302,7 @@ public: //--------------------------------------------------- property handling
      in this case it returns an invalid property */
     template <class T> Vertex_property<T> add_vertex_property(const std::string& name, const T t=T())
     {
+        unshare();
         return Vertex_property<T>(vprops_.add<T>(name, t));
     }
     /** add a halfedge property of type \c T with name \c name and default value \c t.
@@ -1263,6 +1310,7 @@ public: //--------------------------------------------------- property handling
      in this case it returns an invalid property */
     template <class T> Halfedge_property<T> add_halfedge_property(const std::string& name, const T t=T())
     {
+        unshare();
         return Halfedge_property<T>(hprops_.add<T>(name, t));
     }
     /** add a edge property of type \c T with name \c name and default value \c t.
@@ -1270,6 +1318,7 @@ public: //--------------------------------------------------- property handling
      in this case it returns an invalid property */
     template <class T> Edge_property<T> add_edge_property(const std::string& name, const T t=T())
     {
+        unshare();
         return Edge_property<T>(eprops_.add<T>(name, t));
     }
     /** add a face property of type \c T with name \c name and default value \c t.
@@ -1277,6 +1326,7 @@ public: //--------------------------------------------------- property handling
      in this case it returns an invalid property */
     template <class T> Face_property<T> add_face_property(const std::string& name, const T t=T())
     {
+        unshare();
         return Face_property<T>(fprops_.add<T>(name, t));
     }
 
@@ -1287,48 +1337,80 @@ public: //--------------------------------------------------- property handling
     {
         return Vertex_property<T>(vprops_.get<T>(name));
     }
+    /// same as above, but this mesh first gets its own copy of the arrays it shares with
+    /// other meshes, so that the returned handle can be written to. \sa unshare()
+    template <class T> Vertex_property<T> get_vertex_property(const std::string& name)
+    {
+        unshare();
+        return Vertex_property<T>(vprops_.get<T>(name));
+    }
     /** get the halfedge property named \c name of type \c T. returns an invalid
      Vertex_property if the property does not exist or if the type does not match. */
     template <class T> Halfedge_property<T> get_halfedge_property(const std::string& name) const
     {
         return Halfedge_property<T>(hprops_.get<T>(name));
     }
+    /// same as above, but this mesh first gets its own copy of the arrays it shares with
+    /// other meshes, so that the returned handle can be written to. \sa unshare()
+    template <class T> Halfedge_property<T> get_halfedge_property(const std::string& name)
+    {
+        unshare();
+        return Halfedge_property<T>(hprops_.get<T>(name));
+    }
     /** get the edge property named \c name of type \c T. returns an invalid
      Vertex_property if the property does not exist or if the type does not match. */
     template <class T> Edge_property<T> get_edge_property(const std::string& name) const
     {
         return Edge_property<T>(eprops_.get<T>(name));
     }
+    /// same as above, but this mesh first gets its own copy of the arrays it shares with
+    /// other meshes, so that the returned handle can be written to. \sa unshare()
+    template <class T> Edge_property<T> get_edge_property(const std::string& name)
+    {
+        unshare();
+        return Edge_property<T>(eprops_.get<T>(name));
+    }
     /** get the face property named \c name of type \c T. returns an invalid
      Vertex_property if the property does not exist or if the type does not match. */
     template <class T> Face_property<T> get_face_property(const std::string& name) const
     {
         return Face_property<T>(fprops_.get<T>(name));
     }
+    /// same as above, but this mesh first gets its own copy of the arrays it shares with
+    /// other meshes, so that the returned handle can be written to. \sa unshare()
+    template <class T> Face_property<T> get_face_property(const std::string& name)
+    {
+        unshare();
+        return Face_property<T>(fprops_.get<T>(name));
+    }
 
 
     /** if a vertex property of type \c T with name \c name exists, it is returned.
      otherwise this property is added (with default value \c t) */
     template <class T> Vertex_property<T> vertex_property(const std::string& name, const T t=T())
     {
+        unshare();
         return Vertex_property<T>(vprops_.get_or_add<T>(name, t));
     }
     /** if a halfedge property of type \c T with name \c name exists, it is returned.
      otherwise this property is added (with default value \c t) */
     template <class T> Halfedge_property<T> halfedge_property(const std::string& name, const T t=T())
     {
+        unshare();
         return Halfedge_property<T>(hprops_.get_or_add<T>(name, t));
     }
     /** if an edge property of type \c T with name \c name exists, it is returned.
      otherwise this property is added (with default value \c t) */
     template <class T> Edge_property<T> edge_property(const std::string& name, const T t=T())
     {
+        unshare();
         return Edge_property<T>(eprops_.get_or_add<T>(name, t));
     }
     /** if a face property of type \c T with name \c name exists, it is returned.
      otherwise this property is added (with default value \c t) */
     template <class T> Face_property<T> face_property(const std::string& name, const T t=T())
     {
+        unshare();
         return Face_property<T>(fprops_.get_or_add<T>(name, t));
     }
 
@@ -1682,6 +1764,12 @@ public: //--------------------------------------------- higher-level operations
     /// deletes the face \c f from the mesh
     void delete_face(Face f);
 
+    /// deletes the faces \c f for which \c mask[f] is true, and removes them with garbage_collection().
+    /// The faces are processed in parallel. The connectivity is equivalent to the one a sequence of
+    /// delete_face() would give, but the outgoing halfedge chosen for a boundary vertex may differ
+    /// (it is still a boundary halfedge).
+    void delete_faces(const std::vector<bool>& mask);
+
     /// compute a characteristic feature size for the mesh
     float feature_size() {
         std::vector<float> samples(n_edges());
@@ -1715,6 +1803,15 @@ public: //------------------------------------------ geometry-related functions
     /// vector of vertex positions
     std::vector<Point>& points() { return vpoint_.vector(); }
 
+    /// vector of vertex positions (read only)
+    const std::vector<Point>& points() const { return vpoint_.vector(); }
+
+    /// vertex positions as a 2 x vertices_size() matrix, a zero-copy view of points()
+    Eigen::Map<Eigen_view<Point>::Matrix> points_matrix() { return matrix_view(points()); }
+
+    /// vertex positions as a 2 x vertices_size() matrix (read only)
+    Eigen::Map<const Eigen_view<Point>::Matrix> points_matrix() const { return matrix_view(points()); }
+
     /// compute face normals by calling compute_face_normal(Face) for each face.
     void update_face_normals();
 
@@ -1740,6 +1837,7 @@ private: //---------------------------------------------- allocate new elements
     /// allocate a new vertex, resize vertex properties accordingly.
     Vertex new_vertex()
     {
+        unshare();
         vprops_.push_back();
         return Vertex(vertices_size()-1);
     }
@@ -1749,6 +1847,7 @@ private: //---------------------------------------------- allocate new elements
     {
         assert(start != end);
 
+        unshare();
         eprops_.push_back();
         hprops_.push_back();
         hprops_.push_back();
@@ -1765,6 +1864,8 @@ private: //---------------------------------------------- allocate new elements
     /// allocate a new face, resize face properties accordingly.
     Face new_face()
     {
+        unshare();
+        invalidate_face_vertex_indices();
         fprops_.push_back();
         return Face(faces_size()-1);
     }
@@ -1787,6 +1888,27 @@ private: //--------------------------------------------------- helper functions
     /// are there deleted vertices, edges or faces?
     bool garbage() const { return garbage_; }
 
+    /// gives this mesh its own copy of the property arrays it shares with other meshes, if any.
+    /// must be called before any modification of the connectivity or of the properties.
+    void unshare()
+    {
+        if (shared_token_.use_count() > 1)
+            unshare_properties(true);
+    }
+
+    /// detaches the shared property arrays, empty arrays are created if \c keep_data is false
+    void unshare_properties(bool keep_data);
+
+    /// fetches the handles of the standard properties from the property containers
+    void update_property_handles();
+
+    /// drops the cache of face_vertex_indices(), must be called when faces are modified
+    void invalidate_face_vertex_indices()
+    {
+        if (face_vertex_indices_)
+            face_vertex_indices_.reset();
+    }
+
 
 
 private: //------------------------------------------------------- private data
@@ -1816,6 +1938,12 @@ private: //------------------------------------------------------- private data
     unsigned int deleted_faces_;
     bool garbage_;
 
+    // shared by the copies of the mesh as long as they share their property arrays
+    std::shared_ptr<char> shared_token_;
+
+    // cache of face_vertex_indices(), shared by the copies of the mesh
+    mutable std::shared_ptr<const std::vector<Eigen::Array4i> > face_vertex_indices_;
+
     // helper data for add_face()
     typedef std::pair<Halfedge, Halfedge>  NextCacheEntry;
     typedef std::vector<NextCacheEntry>    NextCache;
@@ -29,6 +29,8 @@
 #include <algorithm>
 #include <typeinfo>
 #include <iostream>
+#include <memory>
+#include <type_traits>
 
 
 //== NAMESPACE ================================================================
@@ -68,9 +70,16 @@ public:
     /// Let two elements swap their storage place.
     virtual void swap(size_t i0, size_t i1) = 0;
 
+    /// Move each element i with map[i]>=0 to map[i], and keep the n first elements.
+    /// The moved elements must not overwrite elements that are moved or kept.
+    virtual void compact(const std::vector<int>& map, size_t n) = 0;
+
     /// Return a deep copy of self.
     virtual Base_property_array* clone () const = 0;
 
+    /// Return an empty array with the same name and default value.
+    virtual Base_property_array* empty_clone () const = 0;
+
     /// Return the type_info of the property
     virtual const std::type_info& type() = 0;
 
@@ -135,6 +144,17 @@ public: // virtual interface of Base_property_array
         data_[i1]=d;
     }
 
+    virtual void compact(const std::vector<int>& map, size_t n)
+    {
+        // the packed bits of std::vector<bool> cannot be written concurrently
+        int size = int(data_.size());
+        #pragma omp parallel for if(!std::is_same<T,bool>::value)
+        for (int i=0; i<size; ++i)
+            if (map[i]>=0 && map[i]!=i)
+                data_[map[i]] = data_[i];
+        data_.resize(n);
+    }
+
     virtual Base_property_array* clone() const
     {
         Property_array<T>* p = new Property_array<T>(name_, value_);
@@ -142,6 +162,11 @@ public: // virtual interface of Base_property_array
         return p;
     }
 
+    virtual Base_property_array* empty_clone() const
+    {
+        return new Property_array<T>(name_, value_);
+    }
+
     virtual const std::type_info& type() { return typeid(T); }
 
 
@@ -160,6 +185,12 @@ public:
         return data_;
     }
 
+    /// Get const reference to the underlying vector
+    const std::vector<T>& vector() const
+    {
+        return data_;
+    }
+
 
     /// Access the i'th element. No range check is performed!
     reference operator[](int _idx)
@@ -248,6 +279,12 @@ public:
         return parray_->vector();
     }
 
+    const std::vector<T>& vector() const
+    {
+        assert(parray_ != NULL);
+        return parray_->vector();
+    }
+
 
 private:
 
@@ -280,26 +317,42 @@ public:
     // default constructor
     Property_container() : size_(0) {}
 
-    // destructor (deletes all property arrays)
+    // destructor (releases all property arrays)
     virtual ~Property_container() { clear(); }
 
-    // copy constructor: performs deep copy of property arrays
+    // copy constructor: shares the property arrays of _rhs, see detach()
     Property_container(const Property_container& _rhs) { operator=(_rhs); }
 
-    // assignment: performs deep copy of property arrays
+    // assignment: shares the property arrays of _rhs, see detach()
     Property_container& operator=(const Property_container& _rhs)
     {
         if (this != &_rhs)
         {
-            clear();
-            parrays_.resize(_rhs.n_properties());
+            parrays_ = _rhs.parrays_;
             size_ = _rhs.size();
-            for (unsigned int i=0; i<parrays_.size(); ++i)
-                parrays_[i] = _rhs.parrays_[i]->clone();
         }
         return *this;
     }
 
+    // Copies are cheap as the property arrays are shared until detach() is called.
+    // Shared arrays must not be modified, thus all the handles obtained before
+    // a call to detach() have to be fetched again.
+    // If keep_data is false, the shared arrays are replaced by empty ones (the size of the container is not updated).
+    void detach(bool keep_data=true)
+    {
+        for (unsigned int i=0; i<parrays_.size(); ++i)
+            if (parrays_[i].use_count() > 1)
+                parrays_[i].reset(keep_data ? parrays_[i]->clone() : parrays_[i]->empty_clone());
+    }
+
+    // same as above for the property named \c name only
+    void detach(const std::string& name)
+    {
+        for (unsigned int i=0; i<parrays_.size(); ++i)
+            if (parrays_[i]->name() == name && parrays_[i].use_count() > 1)
+                parrays_[i].reset(parrays_[i]->clone());
+    }
+
     // returns the current size of the property arrays
     size_t size() const { return size_; }
 
@@ -333,7 +386,7 @@ public:
         // otherwise add the property
         Property_array<T>* p = new Property_array<T>(name, t);
         p->resize(size_);
-        parrays_.push_back(p);
+        parrays_.push_back(std::shared_ptr<Base_property_array>(p));
         return Property<T>(p);
     }
 
@@ -343,7 +396,7 @@ public:
     {
         for (unsigned int i=0; i<parrays_.size(); ++i)
             if (parrays_[i]->name() == name)
-                return Property<T>(dynamic_cast<Property_array<T>*>(parrays_[i]));
+                return Property<T>(dynamic_cast<Property_array<T>*>(parrays_[i].get()));
         return Property<T>();
     }
 
@@ -370,12 +423,11 @@ public:
     // delete a property
     template <class T> void remove(Property<T>& h)
     {
-        std::vector<Base_property_array*>::iterator it=parrays_.begin(), end=parrays_.end();
+        std::vector< std::shared_ptr<Base_property_array> >::iterator it=parrays_.begin(), end=parrays_.end();
         for (; it!=end; ++it)
         {
-            if (*it == h.parray_)
+            if (it->get() == h.parray_)
             {
-                delete *it;
                 parrays_.erase(it);
                 h.reset();
                 break;
@@ -387,8 +439,6 @@ public:
     // delete all properties
     void clear()
     {
-        for (unsigned int i=0; i<parrays_.size(); ++i)
-            delete parrays_[i];
         parrays_.clear();
         size_ = 0;
     }
@@ -438,9 +488,17 @@ public:
             parrays_[i]->swap(i0, i1);
     }
 
+    // move the elements as described by map and keep the n first ones, see Base_property_array::compact
+    void compact(const std::vector<int>& map, size_t n)
+    {
+        for (unsigned int i=0; i<parrays_.size(); ++i)
+            parrays_[i]->compact(map, n);
+        size_ = n;
+    }
+
 
 private:
-    std::vector<Base_property_array*>  parrays_;
+    std::vector< std::shared_ptr<Base_property_array> >  parrays_;
     size_t  size_;
 };
 
@@ -24,6 +24,7 @@
 
 
 #include <Eigen/Dense>
+#include <vector>
 
 
 //=============================================================================
@@ -52,6 +53,49 @@ inline Vec3 make_vec3(const Point& p) { return Vec3(p.x(), p.y(), 0.); }
 inline Scalar nan(){ return std::numeric_limits<Scalar>::quiet_NaN(); }
 inline Scalar inf(){ return std::numeric_limits<Scalar>::max(); } 
 
+
+//=============================================================================
+
+
+/// Eigen matrix type viewing an array of n elements of type T:
+/// a n vector for scalar types, and a R x n matrix for R-vectors (Point, Normal, Color).
+template <typename T> struct Eigen_view
+{
+    typedef Eigen::Matrix<T, Eigen::Dynamic, 1> Matrix;
+    enum { rows = 1 };
+};
+
+template <typename S, int R> struct Eigen_view< Eigen::Matrix<S, R, 1> >
+{
+    typedef Eigen::Matrix<S, R, Eigen::Dynamic> Matrix;
+    enum { rows = R };
+};
+
+/// Zero-copy Eigen view of the elements of \c data, e.g., of the vector() of a mesh property,
+/// to process all the elements in a single expression. See Eigen_view for the layout.
+template <typename T>
+Eigen::Map<typename Eigen_view<T>::Matrix> matrix_view(std::vector<T>& data)
+{
+    typedef typename Eigen_view<T>::Matrix Matrix;
+    static_assert(sizeof(T) == Eigen_view<T>::rows*sizeof(typename Matrix::Scalar), "the elements must be packed");
+    Eigen::Index n = data.size();
+    return Eigen::Map<Matrix>(reinterpret_cast<typename Matrix::Scalar*>(data.data()),
+                              Eigen_view<T>::rows==1 ? n : Eigen::Index(Eigen_view<T>::rows),
+                              Eigen_view<T>::rows==1 ? 1 : n);
+}
+
+/// Read only zero-copy Eigen view of the elements of \c data
+template <typename T>
+Eigen::Map<const typename Eigen_view<T>::Matrix> matrix_view(const std::vector<T>& data)
+{
+    typedef typename Eigen_view<T>::Matrix Matrix;
+    static_assert(sizeof(T) == Eigen_view<T>::rows*sizeof(typename Matrix::Scalar), "the elements must be packed");
+    Eigen::Index n = data.size();
+    return Eigen::Map<const Matrix>(reinterpret_cast<const typename Matrix::Scalar*>(data.data()),
+                                    Eigen_view<T>::rows==1 ? n : Eigen::Index(Eigen_view<T>::rows),
+                                    Eigen_view<T>::rows==1 ? 1 : n);
+}
+
 //=============================================================================
 } // namespace surface_mesh
 //=============================================================================
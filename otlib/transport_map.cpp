@@ -16,7 +16,10 @@
 // along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include "transport_map.h"
+#include "otsolver_2dgrid.h"
 #include "utils/bvh2d.h"
+#include "utils/legendre_transform.h"
+#include "utils/mesh_utils.h"
 #include "utils/BenchTimer.h"
 #include "utils/eigen_addons.h"
 
@@ -29,32 +32,244 @@ namespace otmap
 
 TransportMap::TransportMap( std::shared_ptr<surface_mesh::Surface_mesh> origin_mesh,
                             std::shared_ptr<surface_mesh::Surface_mesh> fwd_mesh,
-                            std::shared_ptr<Eigen::VectorXd> density)
-  : m_origin_mesh(origin_mesh), m_fwd_mesh(fwd_mesh), m_density(density), m_bvh_fwd(0), m_bvh_inv(0)
-{}
+                            std::shared_ptr<Eigen::VectorXd> density,
+                            std::shared_ptr<Eigen::VectorXd> potential)
+  : m_grid_size(0), m_density(density), m_potential(potential),
+    m_cache(std::make_shared<Cache>())
+{
+  m_cache->origin_mesh = origin_mesh;
+  m_cache->fwd_mesh = fwd_mesh;
+}
 
-void TransportMap::init_inverse() const
+TransportMap::TransportMap( int grid_size,
+                            std::shared_ptr<Eigen::VectorXd> density,
+                            std::shared_ptr<Eigen::VectorXd> potential,
+                            std::shared_ptr<std::vector<Eigen::Vector2d> > fwd_points)
+  : m_grid_size(grid_size), m_fwd_points(fwd_points), m_density(density), m_potential(potential),
+    m_cache(std::make_shared<Cache>())
+{
+  if(m_fwd_points==nullptr)
+  {
+    MatrixX2d vtx_grads;
+    compute_vertex_gradients(m_grid_size, *m_potential, vtx_grads);
+    m_fwd_points = std::make_shared<std::vector<Vector2d> >(vtx_grads.rows());
+    #pragma omp parallel for
+    for(int j=0; j<vtx_grads.rows(); ++j)
+      (*m_fwd_points)[j] = origin_point(j) + vtx_grads.row(j).transpose();
+  }
+}
+
+void TransportMap::init_meshes() const
+{
+  if(m_grid_size==0)
+    return;
+  std::call_once(m_cache->meshes_flag, [this] () {
+    m_cache->origin_mesh = std::make_shared<Surface_mesh>();
+    generate_quad_mesh(m_grid_size+1, m_grid_size+1, *m_cache->origin_mesh);
+    m_cache->fwd_mesh = std::make_shared<Surface_mesh>(*m_cache->origin_mesh);
+    m_cache->fwd_mesh->points() = *m_fwd_points;
+  });
+}
+
+std::vector<Array4i> TransportMap::face_vertices() const
 {
-  if(m_bvh_fwd==nullptr)
+  std::vector<Array4i> faces;
+  if(m_grid_size>0)
   {
-    m_bvh_fwd = new BVH2D;
-    m_bvh_fwd->build(m_fwd_mesh.get(),4,24);
+    int n = m_grid_size;
+    faces.resize(n*n);
+    for(int i=0; i<n; ++i)
+      for(int j=0; j<n; ++j)
+        faces[j+i*n] << j+i*(n+1), j+(i+1)*(n+1), j+1+(i+1)*(n+1), j+1+i*(n+1);
   }
+  else
+  {
+    faces = m_cache->origin_mesh->face_vertex_indices();
+  }
+  return faces;
+}
+
+void TransportMap::init_inverse() const
+{
+  std::call_once(m_cache->bvh_fwd_flag, [this] () {
+    BVH2D* bvh = new BVH2D;
+    if(m_grid_size>0)
+      bvh->build(*m_fwd_points, face_vertices(), 4, 24);
+    else
+      bvh->build(m_cache->fwd_mesh.get(),4,24);
+    m_cache->bvh_fwd.reset(bvh);
+    m_cache->has_bvh_fwd = true;
+  });
+}
+
+void TransportMap::init_inverse(const TransportMap& ref) const
+{
+  if(ref.m_cache==m_cache || ref.m_grid_size!=m_grid_size)
+    return init_inverse();
+
+  // built before entering our own flag, so that a.init_inverse(b) and b.init_inverse(a) cannot wait on each other
+  ref.init_inverse();
+  std::call_once(m_cache->bvh_fwd_flag, [this,&ref] () {
+    BVH2D* bvh = new BVH2D(*ref.m_cache->bvh_fwd);
+    if(m_grid_size>0)
+      bvh->refit(*m_fwd_points);
+    else
+      bvh->refit(m_cache->fwd_mesh.get());
+    m_cache->bvh_fwd.reset(bvh);
+    m_cache->has_bvh_fwd = true;
+  });
 }
 
 void TransportMap::init_forward() const
 {
-  if(m_bvh_inv==nullptr)
+  // grid-based maps are directly evaluated in the regular origin grid
+  if(m_grid_size>0)
+    return;
+  std::call_once(m_cache->bvh_inv_flag, [this] () {
+    BVH2D* bvh = new BVH2D;
+    bvh->build(m_cache->origin_mesh.get(),4,24);
+    m_cache->bvh_inv.reset(bvh);
+  });
+}
+
+void TransportMap::build_inverse_table(int res) const
+{
+  // the table interpolates between (res-1)x(res-1) cells
+  assert(res>=2);
+  if(res<2)
+    return;
+
+  std::call_once(m_cache->inv_table_flag, [this,res] () { init_inverse_table(res); });
+}
+
+void TransportMap::init_inverse_table(int res) const
+{
+  Cache& cache = *m_cache;
+
+  const std::vector<Vector2d>& fwd_pts = fwd_points();
+  const VectorXd& density = *m_density;
+
+  // gather the corners of the forward quads
+  std::vector<Array4i> quads = face_vertices();
+  int nf = quads.size();
+  for(int f=0; f<nf; ++f)
+    if(quads[f](3)<0)
+      quads[f].setConstant(-1); // only quads are supported
+
+  // bin the quads per band of rows so that bands can be rasterized concurrently
+  double scale = res-1;
+  const int band_height = 8;
+  int nb_bands = (res+band_height-1)/band_height;
+  std::vector<std::vector<int> > bands(nb_bands);
+  std::vector<Array2i> quad_rows(nf);
+  for(int f=0; f<nf; ++f)
+  {
+    if(quads[f](0)<0)
+      continue;
+    double ymin = fwd_pts[quads[f](0)].y(), ymax = ymin;
+    for(int k=1; k<4; ++k)
+    {
+      ymin = std::min(ymin, fwd_pts[quads[f](k)].y());
+      ymax = std::max(ymax, fwd_pts[quads[f](k)].y());
+    }
+    int r0 = std::max(0, int(std::ceil(ymin*scale)));
+    int r1 = std::min(res-1, int(std::floor(ymax*scale)));
+    quad_rows[f] << r0, r1;
+    for(int b=r0/band_height; b<=r1/band_height && r0<=r1; ++b)
+      bands[b].push_back(f);
+  }
+
+  cache.inv_table.assign(res*res, Vector2f::Constant(std::numeric_limits<float>::quiet_NaN()));
+  std::vector<int> texel_faces(res*res, -1);
+
+  #pragma omp parallel for schedule(dynamic)
+  for(int b=0; b<nb_bands; ++b)
   {
-    m_bvh_inv = new BVH2D;
-    m_bvh_inv->build(m_origin_mesh.get(),4,24);
+    for(int f : bands[b])
+    {
+      Vector2d p[4];
+      AlignedBox2d box;
+      box.setEmpty();
+      for(int k=0; k<4; ++k)
+      {
+        p[k] = fwd_pts[quads[f](k)];
+        box.extend(p[k]);
+      }
+      int c0 = std::max(0, int(std::ceil(box.min().x()*scale)));
+      int c1 = std::min(res-1, int(std::floor(box.max().x()*scale)));
+      int r0 = std::max(quad_rows[f](0), b*band_height);
+      int r1 = std::min(quad_rows[f](1), (b+1)*band_height-1);
+      for(int r=r0; r<=r1; ++r)
+      {
+        // test 4 texels at once
+        Array4d qy = Array4d::Constant(r/scale);
+        for(int c4=c0; c4<=c1; c4+=4)
+        {
+          Array4d qx = (Array4d(0,1,2,3)+c4).min(c1)/scale;
+          Array4d u, v;
+          int mask = inside_quad4(qx,qy,p);
+          if(mask)
+            mask &= bilinear_coordinates_in_quad4(qx,qy,p,u,v);
+          for(int l=0; l<4 && c4+l<=c1; ++l)
+          {
+            int id = c4+l+r*res;
+            // among overlapping cells, keep the one with largest density (<=> largest area)
+            if(!(mask>>l & 1) || (texel_faces[id]>=0 && density(texel_faces[id])>=density(f)))
+              continue;
+            Vector2d x = (1.-u(l))*(1.-v(l))*origin_point(quads[f](0)) + u(l)*(1.-v(l))*origin_point(quads[f](1))
+                       +      u(l) *    v(l) *origin_point(quads[f](2)) + (1.-u(l))*v(l)*origin_point(quads[f](3));
+            cache.inv_table[id] = x.cast<float>();
+            texel_faces[id] = f;
+          }
+        }
+      }
+    }
   }
+
+  // A table cell can be interpolated if its four corners are covered by the same or adjacent forward cells
+  auto adjacent = [&quads] (int f0, int f1) {
+    if(f0==f1) return true;
+    for(int i=0; i<4; ++i)
+      for(int j=0; j<4; ++j)
+        if(quads[f0](i)==quads[f1](j))
+          return true;
+    return false;
+  };
+  cache.inv_table_valid.resize((res-1)*(res-1));
+  #pragma omp parallel for
+  for(int r=0; r<res-1; ++r)
+  {
+    for(int c=0; c<res-1; ++c)
+    {
+      int f[4] = { texel_faces[c+r*res], texel_faces[c+1+r*res], texel_faces[c+(r+1)*res], texel_faces[c+1+(r+1)*res] };
+      bool valid = f[0]>=0 && f[1]>=0 && f[2]>=0 && f[3]>=0
+                && adjacent(f[0],f[1]) && adjacent(f[0],f[2]) && adjacent(f[0],f[3]);
+      cache.inv_table_valid[c+r*(res-1)] = valid;
+    }
+  }
+
+  // publish the table only once it is complete
+  cache.inv_table_res = res;
+}
+
+Eigen::Vector2d TransportMap::inv_table_lookup(const Eigen::Vector2d& p) const
+{
+  const Cache& cache = *m_cache;
+  int res = cache.inv_table_res;
+  Vector2d t = p*double(res-1);
+  int c = std::min(int(t.x()), res-2);
+  int r = std::min(int(t.y()), res-2);
+  if(!cache.inv_table_valid[c+r*(res-1)])
+    return Vector2d::Constant(std::numeric_limits<double>::quiet_NaN());
+  float u = float(t.x()-c);
+  float v = float(t.y()-r);
+  int id = c+r*res;
+  return ( (1.f-u)*(1.f-v)*cache.inv_table[id]     + u*(1.f-v)*cache.inv_table[id+1]
+         + (1.f-u)*     v *cache.inv_table[id+res] + u*     v *cache.inv_table[id+res+1] ).cast<double>();
 }
 
 TransportMap::~TransportMap()
 {
-  delete m_bvh_fwd;
-  delete m_bvh_inv;
 }
 
 Eigen::Vector2d TransportMap::inv_impl(const Eigen::Vector2d& p_in,bool fast_mode) const
@@ -71,7 +286,7 @@ Eigen::Vector2d TransportMap::inv_impl(const Eigen::Vector2d& p_in,bool fast_mod
     const VectorXd& density = *m_density;
 
     std::vector<BVH2D::Hit> hits;
-    m_bvh_fwd->query_all(p,hits);
+    m_cache->bvh_fwd->query_all(p,hits);
     if(hits.size()==0)
     {
       Vector2d result;
@@ -80,37 +295,37 @@ Eigen::Vector2d TransportMap::inv_impl(const Eigen::Vector2d& p_in,bool fast_mod
       return result;
     }
 
-    Surface_mesh::Face f = hits[0].face_id;
-    double* w = hits[0].bary_coord;
-    if(hits.size()>1)
-    {
-      // find intersecting face with highest density (area)
-      double best_area = density(f.idx());
-      for(int k=1; k<hits.size(); ++k)
-      {
-        if(density(hits[k].face_id.idx()) > best_area)
-        {
-          f = hits[k].face_id;
-          w = hits[0].bary_coord;
-          best_area = density(hits[k].face_id.idx())>best_area;
-        }
-      }
-    }
+    // find intersecting face with highest density (area)
+    const BVH2D::Hit* best = &hits[0];
+    for(size_t k=1; k<hits.size(); ++k)
+      if(density(hits[k].face_id.idx()) > density(best->face_id.idx()))
+        best = &hits[k];
 
-    int indices[4];
-    int j = 0;
-    for(auto v : m_fwd_mesh->vertices(f))
-      indices[j++] = v.idx();
-
-    Vector2d res = w[0]*m_origin_mesh->points()[indices[0]];
-    for(int i=1;i<j;++i)
-      res += w[i]*m_origin_mesh->points()[indices[i]];
+    Vector2d res = best->bary_coord[0]*origin_point(best->vertex_ids[0]);
+    for(int i=1; i<4 && best->vertex_ids[i]>=0; ++i)
+      res += best->bary_coord[i]*origin_point(best->vertex_ids[i]);
     return res;
   }
   else
   {
+    if(has_inverse_table())
+    {
+      Vector2d res = inv_table_lookup(p);
+      if(!std::isnan(res[0]) || !m_cache->has_bvh_fwd)
+        return res;
+    }
     // otherwise, pick the first (faster)
-    return m_bvh_fwd->interpolate_at(p, m_origin_mesh->points());
+    double w[4];
+    int ids[4];
+    if(!m_cache->bvh_fwd->query(p, w, ids).is_valid())
+    {
+      std::cerr << "Error: no face found. " << p.transpose() << "\n";
+      return Vector2d::Constant(std::numeric_limits<double>::quiet_NaN());
+    }
+    Vector2d res = w[0]*origin_point(ids[0]);
+    for(int i=1; i<4 && ids[i]>=0; ++i)
+      res += w[i]*origin_point(ids[i]);
+    return res;
   }
 }
 
@@ -119,6 +334,20 @@ Eigen::Vector2d TransportMap::fwd_impl(const Eigen::Vector2d& p_in,bool fast_mod
   // snap to [0,1]:
   Vector2d p = p_in.array().max(0.).min(1.);
 
+  if(m_grid_size>0)
+  {
+    // direct bilinear interpolation in the regular origin grid
+    int n = m_grid_size;
+    const std::vector<Vector2d>& pts = *m_fwd_points;
+    Vector2d t = p*double(n);
+    int i = std::min(int(t.x()), n-1);
+    int j = std::min(int(t.y()), n-1);
+    double u = t.x()-i;
+    double v = t.y()-j;
+    return (1.-u)*(1.-v)*pts[j+i*(n+1)]     + u*(1.-v)*pts[j+(i+1)*(n+1)]
+         +      u *    v *pts[j+1+(i+1)*(n+1)] + (1.-u)*v*pts[j+1+i*(n+1)];
+  }
+
   if(!fast_mode)
   {
     // If the target density is given,
@@ -128,7 +357,7 @@ Eigen::Vector2d TransportMap::fwd_impl(const Eigen::Vector2d& p_in,bool fast_mod
     const VectorXd& density = *m_density;
 
     std::vector<BVH2D::Hit> hits;
-    m_bvh_inv->query_all(p,hits);
+    m_cache->bvh_inv->query_all(p,hits);
     if(hits.size()==0)
     {
       std::cerr << "Error: no face found. " << p.transpose() << "\n";
@@ -151,23 +380,131 @@ Eigen::Vector2d TransportMap::fwd_impl(const Eigen::Vector2d& p_in,bool fast_mod
       }
     }
 
-    int indices[4];
-    int j = 0;
-    for(auto v : m_origin_mesh->vertices(f))
-      indices[j++] = v.idx();
+    const Array4i& indices = m_cache->origin_mesh->face_vertex_indices()[f.idx()];
+    int j = indices[3]<0 ? 3 : 4;
 
-    Vector2d res = w[0]*m_fwd_mesh->points()[indices[0]];
+    Vector2d res = w[0]*m_cache->fwd_mesh->points()[indices[0]];
     for(int i=1;i<j;++i)
-      res += w[i]*m_fwd_mesh->points()[indices[i]];
+      res += w[i]*m_cache->fwd_mesh->points()[indices[i]];
     return res;
   }
   else
   {
     // otherwise, pick the first (faster)
-    return m_bvh_inv->interpolate_at(p, m_fwd_mesh->points());
+    return m_cache->bvh_inv->interpolate_at(p, m_cache->fwd_mesh->points());
+  }
+}
+
+
+ComposedTransportMap::ComposedTransportMap(const TransportMap& src, const TransportMap& dst)
+{
+  append_forward(src);
+  append_inverse(dst);
+}
+
+ComposedTransportMap& ComposedTransportMap::append_forward(const TransportMap& tmap)
+{
+  m_steps.push_back(Step{tmap, false});
+  return *this;
+}
+
+ComposedTransportMap& ComposedTransportMap::append_inverse(const TransportMap& tmap)
+{
+  m_steps.push_back(Step{tmap, true});
+  return *this;
+}
+
+void ComposedTransportMap::init() const
+{
+  int nb_steps = m_steps.size();
+  for(int k=0; k<nb_steps; ++k)
+  {
+    const TransportMap& tmap = m_steps[k].tmap;
+    if(!m_steps[k].inverse)
+    {
+      tmap.init_forward();
+      continue;
+    }
+    // look for another map of the chain sharing the same grid, preferably one that is inverted too
+    int ref = -1;
+    for(int l=0; l<nb_steps && tmap.grid_size()>0; ++l)
+    {
+      if(l!=k && m_steps[l].tmap.grid_size()==tmap.grid_size() && (ref<0 || (m_steps[l].inverse && !m_steps[ref].inverse)))
+        ref = l;
+    }
+    if(ref>=0)
+      tmap.init_inverse(m_steps[ref].tmap);
+    else
+      tmap.init_inverse();
+  }
+}
+
+Eigen::Vector2d ComposedTransportMap::operator()(const Eigen::Vector2d& p) const
+{
+  return eval(0, p);
+}
+
+Eigen::Vector2d ComposedTransportMap::eval(int first_step, const Eigen::Vector2d& p) const
+{
+  Vector2d q = p;
+  for(int k=first_step; k<int(m_steps.size()); ++k)
+  {
+    const Step& step = m_steps[k];
+    if(step.inverse)
+    {
+      Vector2d x = step.tmap.has_inverse_table() ? step.tmap.inv_fast(q) : step.tmap.inv(q);
+      if(!std::isnan(x[0]) && !std::isnan(x[1]))
+        q = x;
+    }
+    else
+      q = step.tmap.fwd(q);
+  }
+  return q;
+}
+
+void ComposedTransportMap::apply(std::vector<Eigen::Vector2d>& points, int verbose_level) const
+{
+  apply_steps(0, points, verbose_level);
+}
+
+void ComposedTransportMap::apply_to_origin_vertices(std::vector<Eigen::Vector2d>& points, int verbose_level) const
+{
+  assert(!m_steps.empty());
+  const Step& first = m_steps[0];
+  if(first.inverse)
+  {
+    int n = first.tmap.fwd_points().size();
+    points.resize(n);
+    for(int i=0; i<n; ++i)
+      points[i] = first.tmap.origin_point(i);
+    apply_steps(0, points, verbose_level);
+  }
+  else
+  {
+    points = first.tmap.fwd_points();
+    apply_steps(1, points, verbose_level);
   }
 }
 
+void ComposedTransportMap::apply_steps(int first_step, std::vector<Eigen::Vector2d>& points, int verbose_level) const
+{
+  BenchTimer t_init, t_queries;
+
+  t_init.start();
+  init();
+  t_init.stop();
+
+  t_queries.start();
+  int n = points.size();
+  #pragma omp parallel for
+  for(int i=0; i<n; ++i)
+    points[i] = eval(first_step, points[i]);
+  t_queries.stop();
+
+  if(verbose_level>=2)
+    std::cout << "Composition: init(" << t_init.value(REAL_TIMER) << ") + queries(" << t_queries.value(REAL_TIMER) << ") = "
+              << t_init.value(REAL_TIMER)+t_queries.value(REAL_TIMER) << "\n";
+}
 
 void
 apply_inverse_map(const otmap::TransportMap& tmap, std::vector<Vector2d> &points, int verbose_level)
@@ -183,10 +520,11 @@ apply_inverse_map(const otmap::TransportMap& tmap, std::vector<Vector2d> &points
   bvh_init = timer.value(REAL_TIMER);
 
   timer.start();
+  #pragma omp parallel for
   for(int i=0; i<points.size(); ++i)
   {
     Vector2d newPoint;
-    newPoint = tmap.inv(points[i]);
+    newPoint = tmap.has_inverse_table() ? tmap.inv_fast(points[i]) : tmap.inv(points[i]);
     if (!std::isnan(newPoint[0]) && !std::isnan(newPoint[1])) {
       points[i] = newPoint;
     }
@@ -198,6 +536,85 @@ apply_inverse_map(const otmap::TransportMap& tmap, std::vector<Vector2d> &points
     std::cout << "Inversion: bvh_init(" << bvh_init << ") + bvh_queries(" << bvh_queries << ") = " << bvh_init+bvh_queries << "\n";
 }
 
+void
+compute_inverse_mesh(const otmap::TransportMap& tmap, Surface_mesh& inv_mesh, int verbose_level)
+{
+  int n = tmap.grid_size();
+  if(n>0)
+    generate_quad_mesh(n+1, n+1, inv_mesh);
+  else
+    inv_mesh = tmap.origin_mesh();
+
+  if(n==0 || !tmap.has_potential())
+  {
+    apply_inverse_map(tmap, inv_mesh.points(), verbose_level);
+    return;
+  }
+
+  BenchTimer timer;
+  timer.start();
+
+  const VectorXd& psi = tmap.potential();
+  const VectorXd& density = tmap.density();
+  const std::vector<Point>& fwd_points = tmap.fwd_points();
+  std::vector<Point>& inv_points = inv_mesh.points();
+  auto vtx_index = [n] (int i, int j) { return j+i*(n+1); };
+
+  // The forward map is the gradient of the convex potential u(x) = x^2/2 + psi(x),
+  // thus the inverse map is the gradient of its Legendre transform u*.
+  // u is sampled at the cell centers, and u* at the vertices of the grid.
+  double h = 1./double(n);
+  VectorXd x = (VectorXd::LinSpaced(n,0,n-1).array()+0.5)*h;
+  VectorXd s = VectorXd::LinSpaced(n+1,0,1);
+  MatrixXd u(n,n);
+  for(int i=0; i<n; ++i)
+    for(int j=0; j<n; ++j)
+      u(i,j) = 0.5*(x(i)*x(i)+x(j)*x(j)) + psi(j+i*n);
+
+  MatrixXd us;
+  MatrixXi arg0, arg1;
+  legendre_transform_2d(x, x, u, s, s, us, &arg0, &arg1);
+
+  // The maximizer only gives the inverse up to the grid resolution,
+  // so let's find the exact pre-image in the forward cells around it.
+  const int radius = 2;
+  #pragma omp parallel for
+  for(int k=0; k<=n; ++k)
+  {
+    for(int l=0; l<=n; ++l)
+    {
+      Vector2d q(s(k), s(l));
+      int i0 = arg0(k,l);
+      int j0 = arg1(k,l);
+      // the maximizer is a sub-gradient of u*, it is our fallback if q is not covered by any non-degenerate cell
+      Vector2d res(x(i0), x(j0));
+      double best_density = -1;
+      for(int i=std::max(0,i0-radius); i<=std::min(n-1,i0+radius); ++i)
+      {
+        for(int j=std::max(0,j0-radius); j<=std::min(n-1,j0+radius); ++j)
+        {
+          Vector2d p[4] = { fwd_points[vtx_index(i,j)],   fwd_points[vtx_index(i+1,j)],
+                            fwd_points[vtx_index(i+1,j+1)], fwd_points[vtx_index(i,j+1)] };
+          double a, b;
+          // among overlapping cells, keep the one with largest density (<=> largest area)
+          if(density(j+i*n)>best_density && inside_quad(q,p) && bilinear_coordinates_in_quad(q,p,a,b)
+             // reject extrapolated coordinates in degenerate cells
+             && a>=0. && a<=1. && b>=0. && b<=1.)
+          {
+            best_density = density(j+i*n);
+            res << (i+a)*h, (j+b)*h;
+          }
+        }
+      }
+      inv_points[vtx_index(k,l)] = res;
+    }
+  }
+
+  timer.stop();
+  if(verbose_level>=2)
+    std::cout << "Inversion: legendre_transform(" << timer.value(REAL_TIMER) << ")\n";
+}
+
 void
 apply_forward_map(const otmap::TransportMap& tmap, std::vector<Vector2d> &points, int verbose_level)
 {
@@ -212,6 +629,7 @@ apply_forward_map(const otmap::TransportMap& tmap, std::vector<Vector2d> &points
   bvh_init = timer.value(REAL_TIMER);
 
   timer.start();
+  #pragma omp parallel for
   for(int i=0; i<points.size(); ++i)
   {
     points[i] = tmap.fwd(points[i]);
@@ -220,7 +638,7 @@ apply_forward_map(const otmap::TransportMap& tmap, std::vector<Vector2d> &points
   bvh_queries = timer.value(REAL_TIMER);
 
   if(verbose_level>=2)
-    std::cout << "Inversion: bvh_init(" << bvh_init << ") + bvh_queries(" << bvh_queries << ") = " << bvh_init+bvh_queries << "\n";
+    std::cout << "Forward: bvh_init(" << bvh_init << ") + bvh_queries(" << bvh_queries << ") = " << bvh_init+bvh_queries << "\n";
 }
 
 
@@ -284,10 +702,10 @@ transport_cost(const Surface_mesh &src_mesh, const Surface_mesh &dst_mesh, const
     }
     else
     {
-      Surface_mesh::Halfedge h(src_mesh.halfedge(f));
-      Surface_mesh::Vertex  v1 = src_mesh.from_vertex(h);
-      Surface_mesh::Vertex  v2 = src_mesh.to_vertex(h);
-      Surface_mesh::Vertex  v3 = src_mesh.to_vertex(src_mesh.next_halfedge(h));
+      const Array4i& fv = src_mesh.face_vertex_indices()[i];
+      Surface_mesh::Vertex  v1(fv[0]);
+      Surface_mesh::Vertex  v2(fv[1]);
+      Surface_mesh::Vertex  v3(fv[2]);
 
       face_area = signed_area(src_mesh.position(v1), src_mesh.position(v2), src_mesh.position(v3));
 
@@ -310,4 +728,49 @@ transport_cost(const Surface_mesh &src_mesh, const Surface_mesh &dst_mesh, const
   return res/integral;
 }
 
+double
+transport_cost(const GridMesh &src_grid, const GridMesh &dst_grid, const VectorXd &density_per_face, VectorXd *cost_per_face)
+{
+  assert(src_grid.grid_size()==dst_grid.grid_size());
+  int nfaces = src_grid.n_faces();
+  assert(density_per_face.size()==nfaces);
+
+  if(cost_per_face!=0)
+    cost_per_face->resize(nfaces);
+
+  const double z1 =  sqrt(1./3.)/2.+0.5;
+  const double z2 = -sqrt(1./3.)/2.+0.5;
+
+  double res = 0;
+  double integral = 0;
+  #pragma omp parallel for reduction(+:res,integral)
+  for(int i=0; i<nfaces; ++i)
+  {
+    Array4i fv = src_grid.face_vertices(i);
+    Vector2d d[4];
+    for(int k=0; k<4; ++k)
+      d[k] = dst_grid.position(fv[k]) - src_grid.position(fv[k]);
+
+    double face_area = signed_area(src_grid.position(fv[0]), src_grid.position(fv[1]), src_grid.position(fv[2]), src_grid.position(fv[3]));
+
+    auto dist2 = [&](double u, double v) {
+      return  ((1-u) * (1-v) * d[0]
+            +     u  * (1-v) * d[1]
+            +     u  *    v  * d[2]
+            +  (1-u) *    v  * d[3]).squaredNorm();
+    };
+
+    double face_cost = (dist2(z1,z1) + dist2(z1,z2) + dist2(z2,z2) + dist2(z2,z1)) / 4.;
+
+    integral += density_per_face(i) * face_area;
+    face_cost = density_per_face(i) * face_area * face_cost;
+    res += face_cost;
+    if(cost_per_face!=0)
+      (*cost_per_face)(i) = face_cost;
+  }
+  if(cost_per_face!=0)
+    (*cost_per_face) /= integral;
+  return res/integral;
+}
+
 }
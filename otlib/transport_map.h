@@ -19,7 +19,11 @@
 
 #include <Eigen/Core>
 #include "surface_mesh/Surface_mesh.h"
+#include "utils/grid_mesh.h"
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 namespace otmap
 {
@@ -30,51 +34,213 @@ class TransportMap
 {
 public:
 
+  /** \a potential is optional, if given it must hold the potential psi of the forward map,
+    * i.e., fwd(x) = x + grad psi(x), sampled at the cell centers of the regular grid \a origin_mesh.
+    */
   TransportMap( std::shared_ptr<surface_mesh::Surface_mesh> origin_mesh,
                 std::shared_ptr<surface_mesh::Surface_mesh> fwd_mesh,
-                std::shared_ptr<Eigen::VectorXd> density);
+                std::shared_ptr<Eigen::VectorXd> density,
+                std::shared_ptr<Eigen::VectorXd> potential = std::shared_ptr<Eigen::VectorXd>());
+
+  /** Creates the transport map of the regular grid of \a grid_size x \a grid_size cells.
+    * The vertex (i,j) of the grid is located at (i,j)/grid_size and has index j+i*(grid_size+1),
+    * and \a fwd_points holds its image through the map.
+    * If \a fwd_points is null, then it is computed from the \a potential.
+    * Only the forward vertex positions are stored, the grid topology is implicit,
+    * and the origin and forward meshes are generated lazily when explicitly requested (e.g., for export).
+    */
+  TransportMap( int grid_size,
+                std::shared_ptr<Eigen::VectorXd> density,
+                std::shared_ptr<Eigen::VectorXd> potential,
+                std::shared_ptr<std::vector<Eigen::Vector2d> > fwd_points = std::shared_ptr<std::vector<Eigen::Vector2d> >());
+
+  /** Copies share the lazily built meshes and look-up structures of \a other */
   TransportMap(const TransportMap& other) = default;
 
   ~TransportMap();
 
-  /** this function must be called at least once before calling inv/inv_fast */
+  /** this function must be called at least once before calling inv/inv_fast.
+    * It is thread-safe, and the look-up structure is built only once for a map and all its copies. */
   void init_inverse() const;
+  /** same as init_inverse() but refits the look-up structure of \a ref that must share the same topology */
+  void init_inverse(const TransportMap& ref) const;
+  /** same as init_inverse() for fwd, grid-based maps do not need any look-up structure */
   void init_forward() const;
 
+  /** Rasterizes the forward cells into a \a res x \a res table of origin coordinates
+    * sampling the inverse map at the points (i,j)/(res-1).
+    * Afterwards, inv_fast() answers queries by a bilinear fetch in this table, and falls back to the BVH
+    * (if init_inverse() has been called) for queries in table cells that are not covered or straddle non-adjacent forward cells.
+    * \a res must be at least 2, otherwise no table is built.
+    * It is thread-safe, and the table is built only once for a map and all its copies: later calls are ignored whatever \a res.
+    */
+  void build_inverse_table(int res) const;
+  bool has_inverse_table() const { return m_cache->inv_table_res>0; }
+
   Eigen::Vector2d fwd(const Eigen::Vector2d& p) const { return fwd_impl(p,false); }
   Eigen::Vector2d inv(const Eigen::Vector2d& p) const { return inv_impl(p,false); }
   Eigen::Vector2d inv_fast(const Eigen::Vector2d& p) const { return inv_impl(p,true); }
 
-  std::shared_ptr<surface_mesh::Surface_mesh> fwd_mesh_ptr() { return m_fwd_mesh; }
+  std::shared_ptr<surface_mesh::Surface_mesh> fwd_mesh_ptr() { init_meshes(); return m_cache->fwd_mesh; }
   std::shared_ptr<Eigen::VectorXd> density_ptr() { return m_density; }
 
-  const surface_mesh::Surface_mesh& origin_mesh() { return *m_origin_mesh; }
-  const surface_mesh::Surface_mesh& fwd_mesh() { return *m_fwd_mesh; }
+  /** \returns the number of cells per side of the regular grid, or 0 if the map has been built from arbitrary meshes */
+  int grid_size() const { return m_grid_size; }
+
+  /** \returns the images of the vertices of the origin mesh through the map */
+  const std::vector<Eigen::Vector2d>& fwd_points() const { return m_grid_size>0 ? *m_fwd_points : m_cache->fwd_mesh->points(); }
+
+  /** Materializes the origin and forward meshes if needed, this is expensive on grid-based maps */
+  const surface_mesh::Surface_mesh& origin_mesh() const { init_meshes(); return *m_cache->origin_mesh; }
+  const surface_mesh::Surface_mesh& fwd_mesh() const { init_meshes(); return *m_cache->fwd_mesh; }
   const Eigen::VectorXd& density() const { return *m_density; }
 
+  /** \returns the origin and forward grids of grid-based maps, these are cheap to build as only the points are copied */
+  GridMesh origin_grid() const { assert(m_grid_size>0); return GridMesh(m_grid_size); }
+  GridMesh fwd_grid() const { assert(m_grid_size>0); return GridMesh(m_grid_size, *m_fwd_points); }
+
+  bool has_potential() const { return m_potential!=nullptr; }
+  const Eigen::VectorXd& potential() const { return *m_potential; }
+
+  /** \returns the position of the vertex \a v of the origin mesh */
+  Eigen::Vector2d origin_point(int v) const
+  {
+    if(m_grid_size==0)
+      return m_cache->origin_mesh->points()[v];
+    return Eigen::Vector2d(v/(m_grid_size+1), v%(m_grid_size+1)) * (1./double(m_grid_size));
+  }
+
 
 protected:
 
+  /** generates the meshes of grid-based maps if they are missing */
+  void init_meshes() const;
+
+  /** \returns the corners of the faces of the origin mesh, the 4th one being -1 for triangles */
+  std::vector<Eigen::Array4i> face_vertices() const;
+
   Eigen::Vector2d inv_impl(const Eigen::Vector2d& p, bool fast_mode) const;
+  void init_inverse_table(int res) const;
+  Eigen::Vector2d inv_table_lookup(const Eigen::Vector2d& p) const;
   Eigen::Vector2d fwd_impl(const Eigen::Vector2d& p, bool fast_mode) const;
 
 
-  std::shared_ptr<surface_mesh::Surface_mesh> m_origin_mesh;
-  std::shared_ptr<surface_mesh::Surface_mesh> m_fwd_mesh;
+  int m_grid_size; // 0 if the origin mesh is not a known regular grid
+  std::shared_ptr<std::vector<Eigen::Vector2d> > m_fwd_points; // only for grid-based maps
   std::shared_ptr<Eigen::VectorXd> m_density;
-  mutable BVH2D* m_bvh_fwd;
-  mutable BVH2D* m_bvh_inv;
+  std::shared_ptr<Eigen::VectorXd> m_potential;
+  // Meshes and look-up structures built on demand, shared by all copies of the map
+  struct Cache
+  {
+    std::once_flag meshes_flag;
+    std::once_flag bvh_fwd_flag;
+    std::once_flag bvh_inv_flag;
+    std::once_flag inv_table_flag;
+    std::shared_ptr<surface_mesh::Surface_mesh> origin_mesh;
+    std::shared_ptr<surface_mesh::Surface_mesh> fwd_mesh;
+    std::unique_ptr<BVH2D> bvh_fwd;
+    std::unique_ptr<BVH2D> bvh_inv;
+    std::atomic<bool> has_bvh_fwd{false}; // set once bvh_fwd is built, can be checked outside of bvh_fwd_flag
+    // dense inverse look-up table, see build_inverse_table()
+    std::atomic<int> inv_table_res{0}; // 0 until the table is complete
+    std::vector<Eigen::Vector2f> inv_table;
+    std::vector<unsigned char> inv_table_valid; // per table cell flags
+  };
+  std::shared_ptr<Cache> m_cache;
+};
+
+/** Lazy composition of transport maps and of their inverses.
+  * Each step only holds a (shallow) copy of its TransportMap, so that the look-up structures built to evaluate the steps
+  * are shared with the original maps, and no intermediate mesh is ever generated.
+  * Usage:
+  *   ComposedTransportMap map_uv(tmap_u, tmap_v); // x -> tmap_v.inv(tmap_u.fwd(x))
+  *   map_uv.apply(points);
+  */
+class ComposedTransportMap
+{
+public:
+
+  ComposedTransportMap() {}
+
+  /** Creates the map x -> dst.inv(src.fwd(x)), that is the map between the targets of two maps sharing the same source. */
+  ComposedTransportMap(const TransportMap& src, const TransportMap& dst);
+
+  /** Appends x -> tmap.fwd(x) to the chain */
+  ComposedTransportMap& append_forward(const TransportMap& tmap);
+  /** Appends x -> tmap.inv(x) to the chain */
+  ComposedTransportMap& append_inverse(const TransportMap& tmap);
+
+  int nb_steps() const { return m_steps.size(); }
+
+  /** Builds the look-up structures required by the steps.
+    * The structures of maps sharing the same grid are obtained by refitting a common one (see TransportMap::init_inverse(const TransportMap&)).
+    * This function is thread-safe, and is implicitly called by apply() and apply_to_origin_vertices(). */
+  void init() const;
+
+  /** Evaluates the composed map at \a p, init() must have been called.
+    * If an inverse step fails to find a pre-image, then its input is passed unchanged to the next step. */
+  Eigen::Vector2d operator()(const Eigen::Vector2d& p) const;
+
+  /** Evaluates the composed map at all \a points in parallel */
+  void apply(std::vector<Eigen::Vector2d>& points, int verbose_level = 2) const;
+
+  /** Evaluates the composed map at the vertices of the origin mesh of the first map into \a points.
+    * If the first step is a forward map, then its exact forward vertex positions are used. */
+  void apply_to_origin_vertices(std::vector<Eigen::Vector2d>& points, int verbose_level = 2) const;
+
+protected:
+
+  Eigen::Vector2d eval(int first_step, const Eigen::Vector2d& p) const;
+  void apply_steps(int first_step, std::vector<Eigen::Vector2d>& points, int verbose_level) const;
+
+  struct Step {
+    TransportMap tmap;
+    bool inverse;
+  };
+  std::vector<Step> m_steps;
 };
 
-/** Inverts uniform mesh relative to a transport map */
+/** Inverts uniform mesh relative to a transport map.
+  * If \a tmap has an inverse table, then it is used through inv_fast() */
 void apply_inverse_map( const otmap::TransportMap& tmap,
                         std::vector<Eigen::Vector2d> &points, /* in-out */
                         int verbose_level = 2);
 
+/** Computes the inverse map at the vertices of the origin mesh of \a tmap into \a inv_mesh.
+  * This is equivalent to copying the origin mesh and calling apply_inverse_map on its vertices,
+  * but if \a tmap holds its potential, then the inverse map is computed without any point-location structure
+  * as the gradient of the discrete Legendre transform of the convex potential x^2/2+psi.
+  */
+void compute_inverse_mesh(const otmap::TransportMap& tmap,
+                          surface_mesh::Surface_mesh& inv_mesh,
+                          int verbose_level = 2);
+
 void apply_forward_map( const otmap::TransportMap& tmap,
                         std::vector<Eigen::Vector2d> &points, /* in-out */
                         int verbose_level = 2);
 
+enum TransportMapFileOption {
+  TMFO_Default          = 0,
+  TMFO_SinglePrecision  = 1, ///< store the potential and density as 32 bits floats
+  TMFO_Compressed       = 2  ///< compress the data (requires zlib, ignored otherwise)
+};
+
+/** Writes the grid size, potential and density of \a tmap into a compact binary file.
+  * \a options is a combination of TransportMapFileOption.
+  * \returns false if \a tmap does not hold its potential or in case of IO error.
+  */
+bool write_transport_map(const TransportMap& tmap, const std::string& filename, int options = TMFO_Default);
+
+/** Reads a transport map written by write_transport_map.
+  * Uncompressed files are memory-mapped when possible.
+  * The meshes of the returned map are regenerated lazily from its potential.
+  * \returns a null pointer in case of failure.
+  */
+std::shared_ptr<TransportMap> read_transport_map(const std::string& filename);
+
 double transport_cost(const surface_mesh::Surface_mesh &src_mesh, const surface_mesh::Surface_mesh &dst_mesh, const Eigen::VectorXd &density_per_face, Eigen::VectorXd *cost_per_face = 0);
 
+/** Same as above for grids sharing the same size, the cost of each quad is integrated with its bilinear interpolation */
+double transport_cost(const GridMesh &src_grid, const GridMesh &dst_grid, const Eigen::VectorXd &density_per_face, Eigen::VectorXd *cost_per_face = 0);
+
 } // namespace otmap
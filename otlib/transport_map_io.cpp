@@ -0,0 +1,245 @@
+// This file is part of otmap, an optimal transport solver.
+//
+// Copyright (C) 2018 Gael Guennebaud <gael.guennebaud@inria.fr>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#include "transport_map.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <iostream>
+
+#ifdef HAS_ZLIB
+#include <zlib.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace Eigen;
+
+namespace otmap
+{
+
+// File layout, in the native byte order of the writer (files are not portable across endianness):
+//  - header (see below)
+//  - payload of payload_size bytes, possibly compressed, holding the potential and then the density,
+//    each of them being grid_size^2 doubles or floats (TMFO_SinglePrecision).
+struct TransportMapFileHeader
+{
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  options;
+  uint32_t  grid_size;
+  uint32_t  reserved;
+  uint64_t  payload_size;
+};
+
+static const char tmap_magic[8] = {'O','T','M','A','P','B','I','N'};
+static const uint32_t tmap_version = 1;
+
+bool write_transport_map(const TransportMap& tmap, const std::string& filename, int options)
+{
+  if(!tmap.has_potential())
+  {
+    std::cerr << "write_transport_map: the transport map does not hold its potential\n";
+    return false;
+  }
+
+  const VectorXd& psi = tmap.potential();
+  const VectorXd& density = tmap.density();
+  int n = std::lround(std::sqrt(double(psi.size())));
+  if(n*n!=psi.size() || density.size()!=psi.size())
+  {
+    std::cerr << "write_transport_map: the transport map is not defined on a regular grid\n";
+    return false;
+  }
+
+#ifndef HAS_ZLIB
+  options &= ~TMFO_Compressed;
+#endif
+
+  // serialize the payload
+  size_t nb_coeffs = psi.size();
+  size_t scalar_size = (options & TMFO_SinglePrecision) ? sizeof(float) : sizeof(double);
+  std::vector<char> payload(2*nb_coeffs*scalar_size);
+  if(options & TMFO_SinglePrecision)
+  {
+    Map<VectorXf>(reinterpret_cast<float*>(payload.data()), nb_coeffs) = psi.cast<float>();
+    Map<VectorXf>(reinterpret_cast<float*>(payload.data())+nb_coeffs, nb_coeffs) = density.cast<float>();
+  }
+  else
+  {
+    std::memcpy(payload.data(), psi.data(), nb_coeffs*scalar_size);
+    std::memcpy(payload.data()+nb_coeffs*scalar_size, density.data(), nb_coeffs*scalar_size);
+  }
+
+#ifdef HAS_ZLIB
+  if(options & TMFO_Compressed)
+  {
+    uLongf compressed_size = compressBound(payload.size());
+    std::vector<char> compressed(compressed_size);
+    if(compress(reinterpret_cast<Bytef*>(compressed.data()), &compressed_size,
+                reinterpret_cast<const Bytef*>(payload.data()), payload.size()) != Z_OK)
+    {
+      std::cerr << "write_transport_map: compression failed\n";
+      return false;
+    }
+    compressed.resize(compressed_size);
+    payload.swap(compressed);
+  }
+#endif
+
+  TransportMapFileHeader header;
+  std::memcpy(header.magic, tmap_magic, sizeof(tmap_magic));
+  header.version = tmap_version;
+  header.options = options;
+  header.grid_size = n;
+  header.reserved = 0;
+  header.payload_size = payload.size();
+
+  FILE* out = fopen(filename.c_str(), "wb");
+  if(!out)
+    return false;
+  bool ok = fwrite(&header, sizeof(header), 1, out)==1
+         && fwrite(payload.data(), 1, payload.size(), out)==payload.size();
+  fclose(out);
+  return ok;
+}
+
+// Parses the content of a file written by write_transport_map.
+static std::shared_ptr<TransportMap> parse_transport_map(const char* data, size_t size)
+{
+  TransportMapFileHeader header;
+  if(size<sizeof(header))
+    return nullptr;
+  std::memcpy(&header, data, sizeof(header));
+  if(std::memcmp(header.magic, tmap_magic, sizeof(tmap_magic))!=0)
+  {
+    std::cerr << "read_transport_map: not a transport map file\n";
+    return nullptr;
+  }
+  if(header.version==0 || header.version>tmap_version)
+  {
+    std::cerr << "read_transport_map: unsupported version " << header.version << "\n";
+    return nullptr;
+  }
+  if(header.grid_size==0 || header.payload_size>size-sizeof(header))
+  {
+    std::cerr << "read_transport_map: corrupted header\n";
+    return nullptr;
+  }
+
+  // bound the decoded size by what the payload can hold before allocating anything,
+  // deflate cannot compress by more than 1032:1
+  const size_t max_compression_ratio = 1032;
+  size_t max_raw_size = header.payload_size * ((header.options & TMFO_Compressed) ? max_compression_ratio : 1);
+  size_t nb_coeffs = size_t(header.grid_size)*size_t(header.grid_size);
+  size_t scalar_size = (header.options & TMFO_SinglePrecision) ? sizeof(float) : sizeof(double);
+  if(nb_coeffs>max_raw_size/(2*scalar_size))
+  {
+    std::cerr << "read_transport_map: truncated payload\n";
+    return nullptr;
+  }
+  size_t raw_size = 2*nb_coeffs*scalar_size;
+
+  const char* payload = data + sizeof(header);
+
+  std::vector<char> uncompressed;
+  if(header.options & TMFO_Compressed)
+  {
+#ifdef HAS_ZLIB
+    uncompressed.resize(raw_size);
+    uLongf uncompressed_size = raw_size;
+    if(uncompress(reinterpret_cast<Bytef*>(uncompressed.data()), &uncompressed_size,
+                  reinterpret_cast<const Bytef*>(payload), header.payload_size) != Z_OK
+       || uncompressed_size!=raw_size)
+    {
+      std::cerr << "read_transport_map: decompression failed\n";
+      return nullptr;
+    }
+    payload = uncompressed.data();
+#else
+    std::cerr << "read_transport_map: compressed files require zlib\n";
+    return nullptr;
+#endif
+  }
+  else if(header.payload_size!=raw_size)
+    return nullptr;
+
+  auto psi = std::make_shared<VectorXd>(nb_coeffs);
+  auto density = std::make_shared<VectorXd>(nb_coeffs);
+  if(header.options & TMFO_SinglePrecision)
+  {
+    // the payload might not be aligned
+    VectorXf tmp(nb_coeffs);
+    std::memcpy(tmp.data(), payload, nb_coeffs*scalar_size);
+    *psi = tmp.cast<double>();
+    std::memcpy(tmp.data(), payload+nb_coeffs*scalar_size, nb_coeffs*scalar_size);
+    *density = tmp.cast<double>();
+  }
+  else
+  {
+    std::memcpy(psi->data(), payload, nb_coeffs*scalar_size);
+    std::memcpy(density->data(), payload+nb_coeffs*scalar_size, nb_coeffs*scalar_size);
+  }
+
+  return std::make_shared<TransportMap>(int(header.grid_size), density, psi);
+}
+
+std::shared_ptr<TransportMap> read_transport_map(const std::string& filename)
+{
+#ifndef _WIN32
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd<0)
+    return nullptr;
+  struct stat st;
+  if(fstat(fd, &st)!=0 || st.st_size==0)
+  {
+    close(fd);
+    return nullptr;
+  }
+  size_t size = st.st_size;
+  void* data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(data!=MAP_FAILED)
+  {
+    std::shared_ptr<TransportMap> tmap = parse_transport_map(static_cast<const char*>(data), size);
+    munmap(data, size);
+    return tmap;
+  }
+#endif
+
+  // fallback to regular reads
+  FILE* in = fopen(filename.c_str(), "rb");
+  if(!in)
+    return nullptr;
+  std::vector<char> buffer;
+  char chunk[1<<16];
+  size_t count;
+  while((count = fread(chunk, 1, sizeof(chunk), in))>0)
+    buffer.insert(buffer.end(), chunk, chunk+count);
+  fclose(in);
+  return parse_transport_map(buffer.data(), buffer.size());
+}
+
+} // namespace otmap
@@ -9,8 +9,12 @@
 #include "bvh2d.h"
 
 #include <iostream>
+#include <algorithm>
+#include <limits>
+#include <cassert>
 #include <Eigen/Geometry>
 #include "mesh_utils.h"
+#include "BenchTimer.h"
 
 using namespace surface_mesh;
 using namespace Eigen;
@@ -18,7 +22,16 @@ using namespace Eigen;
 namespace otmap
 {
 
+// enlarge by epsilon
+static void enlarge(Eigen::AlignedBox2d& box)
+{
+  Eigen::Array2d diag = box.max() - box.min();
+  box.min().array() -= (diag*(2.*NumTraits<double>::epsilon()) + NumTraits<double>::epsilon());
+  box.max().array() += (diag*(2.*NumTraits<double>::epsilon()) + NumTraits<double>::epsilon());
+}
+
 BVH2D::BVH2D()
+  : m_target_cell_size(4), m_max_depth(10), m_build_cost(0), m_build_time(0)
 {
 }
 
@@ -28,42 +41,247 @@ BVH2D::~BVH2D()
 
 void BVH2D::build(surface_mesh::Surface_mesh *mesh, int targetCellSize, int maxDepth)
 {
-    mesh_ = mesh;
-
-    m_points = mesh->get_vertex_property<Point>("v:point").vector();
+    BenchTimer timer;
+    timer.start();
 
-    // Number of vertices in the mesh
-    int n_vtx = m_points.size();
+    m_points = mesh->points();
 
-    m_centroids.clear();
     faces_.clear();
+    faces_.reserve(mesh->n_faces());
+    for(auto f : mesh->faces())
+      faces_.push_back(f);
+
+    int nf = faces_.size();
+
+    // gather the corners of each face
+    const std::vector<Array4i>& face_vertices = mesh->face_vertex_indices();
+    m_face_vertices.resize(nf);
+    #pragma omp parallel for
+    for(int i=0; i<nf; ++i)
+    {
+        m_face_vertices[i] = face_vertices[faces_[i].idx()];
+        if(m_face_vertices[i](0)<0)
+          std::cerr << "Invalid polygon with " << mesh->valence(faces_[i]) << " vertices\n";
+    }
+
+    build_hierarchy(targetCellSize, maxDepth);
+
+    timer.stop();
+    m_build_time = timer.value(REAL_TIMER);
+}
+
+void BVH2D::build(const std::vector<Eigen::Vector2d>& points, const std::vector<Eigen::Array4i>& faces, int targetCellSize, int maxDepth)
+{
+    BenchTimer timer;
+    timer.start();
 
-    nodes_.resize(1);
-    nodes_.reserve( std::min<int>(2<<maxDepth, std::max<int>(1,std::log(mesh_->n_faces()/targetCellSize)) ) );
-    m_centroids.resize(mesh_->n_faces());
-    faces_.resize(mesh_->n_faces());
+    m_points = points;
+    m_face_vertices = faces;
 
-    Surface_mesh::Face_iterator fit;
-    int i=0;
-    for (fit = mesh_->faces_begin(); fit != mesh_->faces_end(); ++fit, ++i)
+    int nf = faces.size();
+    faces_.resize(nf);
+    for(int i=0; i<nf; ++i)
+      faces_[i] = Surface_mesh::Face(i);
+
+    build_hierarchy(targetCellSize, maxDepth);
+
+    timer.stop();
+    m_build_time = timer.value(REAL_TIMER);
+}
+
+void BVH2D::build_hierarchy(int targetCellSize, int maxDepth)
+{
+    m_target_cell_size = targetCellSize;
+    m_max_depth = maxDepth;
+
+    int nf = faces_.size();
+
+    m_centroids.resize(nf);
+    m_face_boxes.resize(nf);
+    m_order.resize(nf);
+
+    // compute the bounding box and centroid of each face
+    #pragma omp parallel for
+    for(int i=0; i<nf; ++i)
     {
-        m_centroids[i] = Vector2d::Zero();
-        Surface_mesh::Vertex_around_face_circulator vfc, vfc_end;
-        vfc = vfc_end = mesh_->vertices(*fit);
+        const Array4i& ids = m_face_vertices[i];
+        AlignedBox2d box;
+        box.setEmpty();
+        Vector2d c = Vector2d::Zero();
         int j=0;
-        do {
-            m_centroids[i] += m_points[(*vfc).idx()];
-            j++;
-        } while (++vfc != vfc_end);
-        m_centroids[i] /= j;
-        faces_[i] = (*fit);
+        for(; j<4 && ids(j)>=0; ++j)
+        {
+            box.extend(m_points[ids(j)]);
+            c += m_points[ids(j)];
+        }
+        m_face_boxes[i] = box;
+        m_centroids[i] = c / double(j);
+        m_order[i] = i;
+    }
+
+    // Each split produces two non-empty children, thus there is at most 2*nf-1 nodes.
+    // Allocating them all at once keeps node references valid while subtrees are built concurrently.
+    nodes_.resize(std::max(1,2*nf-1));
+    std::atomic<int> node_count(1);
+
+    #pragma omp parallel
+    #pragma omp single nowait
+    buildNode(0, 0, nf, 0, targetCellSize, maxDepth, &node_count);
+
+    nodes_.resize(node_count);
+
+    // store faces in leaf order
+    std::vector<Surface_mesh::Face> sorted_faces(nf);
+    std::vector<Array4i> sorted_face_vertices(nf);
+    #pragma omp parallel for
+    for(int i=0; i<nf; ++i)
+    {
+        sorted_faces[i] = faces_[m_order[i]];
+        sorted_face_vertices[i] = m_face_vertices[m_order[i]];
+    }
+    faces_.swap(sorted_faces);
+    m_face_vertices.swap(sorted_face_vertices);
+
+    // release build-time data
+    std::vector<int>().swap(m_order);
+    std::vector<Vector2d>().swap(m_centroids);
+    std::vector<AlignedBox2d>().swap(m_face_boxes);
+
+    // group the inner nodes per depth for refit(), children are always stored after their parent
+    std::vector<int> depth(nodes_.size(), 0);
+    m_inner_levels.clear();
+    for(int i=0; i<int(nodes_.size()); ++i)
+    {
+      const Node& node = nodes_[i];
+      if(node.is_leaf)
+        continue;
+      depth[node.first_child_id] = depth[node.first_child_id+1] = depth[i]+1;
+      if(int(m_inner_levels.size())<=depth[i])
+        m_inner_levels.resize(depth[i]+1);
+      m_inner_levels[depth[i]].push_back(i);
+    }
+
+    update_face_coords();
+
+    m_build_cost = sah_cost();
+}
+
+void BVH2D::update_face_coords()
+{
+    int nf = m_face_vertices.size();
+    // padded such that packets of 4 faces can always be loaded at once
+    for(int k=0; k<4; ++k)
+    {
+        m_face_x[k].assign(nf+3, 0.);
+        m_face_y[k].assign(nf+3, 0.);
+    }
+    #pragma omp parallel for
+    for(int i=0; i<nf; ++i)
+    {
+        const Array4i& ids = m_face_vertices[i];
+        for(int k=0; k<4; ++k)
+        {
+            // triangles are stored as degenerate quads, they are not tested through these arrays anyway
+            const Vector2d& p = m_points[ids(k)>=0 ? ids(k) : ids(0)];
+            m_face_x[k][i] = p.x();
+            m_face_y[k][i] = p.y();
+        }
+    }
+}
+
+bool BVH2D::refit(surface_mesh::Surface_mesh *mesh, double max_cost_ratio)
+{
+    if(nodes_.empty() || mesh->n_faces()!=faces_.size() || mesh->n_vertices()!=m_points.size())
+    {
+      build(mesh, m_target_cell_size, m_max_depth);
+      return false;
+    }
+
+    return refit(mesh->points(), max_cost_ratio);
+}
+
+bool BVH2D::refit(const std::vector<Eigen::Vector2d>& points, double max_cost_ratio)
+{
+    if(nodes_.empty() || points.size()!=m_points.size())
+    {
+      // the faces can only be kept if they still index valid points
+      int nv = points.size();
+      bool valid = !faces_.empty();
+      for(size_t i=0; i<m_face_vertices.size() && valid; ++i)
+        valid = (m_face_vertices[i] < nv).all();
+      if(valid)
+      {
+        BenchTimer timer;
+        timer.start();
+        m_points = points;
+        build_hierarchy(m_target_cell_size, m_max_depth);
+        timer.stop();
+        m_build_time = timer.value(REAL_TIMER);
+      }
+      return false;
+    }
+
+    m_points = points;
+    update_face_coords();
+
+    int nb_nodes = nodes_.size();
+
+    // update the leaves
+    #pragma omp parallel for
+    for(int i=0; i<nb_nodes; ++i)
+    {
+      Node& node = nodes_[i];
+      if(!node.is_leaf)
+        continue;
+      AlignedBox2d aabb;
+      aabb.setEmpty();
+      for(int k=node.first_face_id; k<node.first_face_id+node.nb_faces; ++k)
+        for(int j=0; j<4 && m_face_vertices[k](j)>=0; ++j)
+          aabb.extend(m_points[m_face_vertices[k](j)]);
+      node.box = aabb;
+      enlarge(node.box);
+    }
+
+    // and propagate to the inner nodes level by level, the nodes of a level are independent
+    for(int l=int(m_inner_levels.size())-1; l>=0; --l)
+    {
+      const std::vector<int>& level = m_inner_levels[l];
+      int n = level.size();
+      #pragma omp parallel for if(n>=1024)
+      for(int k=0; k<n; ++k)
+      {
+        Node& node = nodes_[level[k]];
+        node.box = nodes_[node.first_child_id].box.merged(nodes_[node.first_child_id+1].box);
+      }
     }
 
-    nodes_.resize(1);
-    buildNode(0, 0, mesh_->n_faces(), 0, targetCellSize, maxDepth);
+    if(max_cost_ratio>0 && sah_cost() > max_cost_ratio*m_build_cost)
+    {
+      // rebuild from the current faces and positions
+      BenchTimer timer;
+      timer.start();
+      build_hierarchy(m_target_cell_size, m_max_depth);
+      timer.stop();
+      m_build_time = timer.value(REAL_TIMER);
+      return false;
+    }
+
+    return true;
 }
 
-Surface_mesh::Face BVH2D::query(const Eigen::Vector2d &p, double *w) const
+/** \returns the SAH cost of the tree relative to the area of the root */
+double BVH2D::sah_cost() const
+{
+  double root_area = nodes_[0].box.volume();
+  if(root_area<=0.)
+    return 0.;
+  double cost = 0;
+  for(const Node& node : nodes_)
+    cost += node.box.volume() * (node.is_leaf ? node.nb_faces : 1);
+  return cost / root_area;
+}
+
+Surface_mesh::Face BVH2D::query(const Eigen::Vector2d &p, double *w, int *vertex_ids) const
 {
   if(nodes_[0].box.contains(p))
   {
@@ -72,6 +290,8 @@ Surface_mesh::Face BVH2D::query(const Eigen::Vector2d &p, double *w) const
     if(hit.size()==1)
     {
       Vector4d::Map(w) = Vector4d::Map(hit[0].bary_coord);
+      if(vertex_ids)
+        Array4i::Map(vertex_ids) = Array4i::Map(hit[0].vertex_ids);
       return hit[0].face_id;
     }
   }
@@ -98,33 +318,49 @@ void BVH2D::intersectNode(int nodeId, const Eigen::Vector2d &target, std::vector
   if(node.is_leaf)
   {
     int end = node.first_child_id+node.nb_faces;
-    for(int i=node.first_child_id; i<end; ++i)
+    // process the faces per packets of 4, quads are first tested all at once
+    for(int i0=node.first_child_id; i0<end; i0+=4)
     {
-      Vector2d pts[4];
-      int j = 0;
-      for(auto v:mesh_->vertices(faces_[i]))
-        pts[j++] = m_points[v.idx()];
-
-      if(j==3)
+      int n = std::min(4, end-i0);
+      int quad_mask = 0;
+      for(int l=0; l<n; ++l)
+        if(m_face_vertices[i0+l](3)>=0)
+          quad_mask |= 1<<l;
+      if(quad_mask)
       {
-        Vector2d uv = bilinear_coordinates_in_triangle(target,pts[0],pts[1],pts[2]);
-        double eps = 1e-8;
-        if((uv.array()>=-eps).all() && uv.sum()<=1.+eps) {
-          Hit hit;
-          hit.bary_coord[0] = uv.x();
-          hit.bary_coord[1] = uv.y();
-          hit.bary_coord[2] = 1.-uv.sum();
-          hit.bary_coord[3] = 0;
-          hit.face_id = faces_[i];
-          hits.push_back(hit);
-          if(stop_at_first)
-            return;
+        Array4d px[4], py[4];
+        for(int k=0; k<4; ++k)
+        {
+          px[k] = Array4d::Map(&m_face_x[k][i0]);
+          py[k] = Array4d::Map(&m_face_y[k][i0]);
         }
+        quad_mask &= inside_quad4(target, px, py);
       }
-      else if(j==4)
+
+      for(int l=0; l<n; ++l)
       {
-        if(inside_quad(target, pts))
+        int i = i0+l;
+        const Array4i& ids = m_face_vertices[i];
+        if(ids(3)<0)
         {
+          Vector2d uv = bilinear_coordinates_in_triangle(target,m_points[ids(0)],m_points[ids(1)],m_points[ids(2)]);
+          double eps = 1e-8;
+          if((uv.array()>=-eps).all() && uv.sum()<=1.+eps) {
+            Hit hit;
+            hit.bary_coord[0] = uv.x();
+            hit.bary_coord[1] = uv.y();
+            hit.bary_coord[2] = 1.-uv.sum();
+            hit.bary_coord[3] = 0;
+            hit.face_id = faces_[i];
+            Array4i::Map(hit.vertex_ids) = ids;
+            hits.push_back(hit);
+            if(stop_at_first)
+              return;
+          }
+        }
+        else if(quad_mask>>l & 1)
+        {
+          Vector2d pts[4] = { m_points[ids(0)], m_points[ids(1)], m_points[ids(2)], m_points[ids(3)] };
           double w[4];
           if(bilinear_coordinates_in_quad(target,pts, Vector4d::Map(w)))
           {
@@ -133,6 +369,7 @@ void BVH2D::intersectNode(int nodeId, const Eigen::Vector2d &target, std::vector
               Hit hit;
               Vector4d::Map(hit.bary_coord) = Vector4d::Map(w);
               hit.face_id = faces_[i];
+              Array4i::Map(hit.vertex_ids) = ids;
               hits.push_back(hit);
               if(stop_at_first)
                 return;
@@ -140,8 +377,6 @@ void BVH2D::intersectNode(int nodeId, const Eigen::Vector2d &target, std::vector
           }
         }
       }
-      else
-        std::cerr << "Invalid polygon with " << j << " vertices\n";
     }
   }
   else
@@ -161,46 +396,93 @@ void BVH2D::intersectNode(int nodeId, const Eigen::Vector2d &target, std::vector
   }
 }
 
-/** Sorts the faces with respect to their centroid along the dimension \a dim and spliting value \a split_value.
-  * \returns the middle index
+/** Partitions the faces of the range [start,end) with respect to their centroid using a binned SAH strategy
+  * along the largest dimension of \a centroid_box.
+  * \returns the middle index, or \a start if no valid split has been found
   */
-int BVH2D::split(int start, int end, int dim, float split_value)
+int BVH2D::split(int start, int end, const Eigen::AlignedBox2d& centroid_box, double node_area)
 {
-  int l(start), r(end-1);
-  while(l<r)
+  const int nb_bins = 16;
+
+  int dim;
+  (centroid_box.max() - centroid_box.min()).maxCoeff(&dim);
+  double cmin = centroid_box.min()(dim);
+  double extent = centroid_box.max()(dim) - cmin;
+  if(extent<=0.)
+    return start; // all centroids are equal
+
+  double scale = double(nb_bins) / extent;
+  auto bin_of = [&] (int k) { return std::min(nb_bins-1, int((m_centroids[k](dim)-cmin)*scale)); };
+
+  int counts[nb_bins];
+  AlignedBox2d boxes[nb_bins];
+  for(int b=0; b<nb_bins; ++b)
   {
-    // find the first on the left
-    while(l<end && m_centroids[l](dim) < split_value) ++l;
-    while(r>=start && m_centroids[r](dim) >= split_value) --r;
-    if(l>=r) break;
-    std::swap(m_centroids[l], m_centroids[r]);
-    std::swap(faces_[l], faces_[r]);
-    ++l;
-    --r;
+    counts[b] = 0;
+    boxes[b].setEmpty();
   }
-  return m_centroids[l][dim]<=split_value ? std::min(end,l+1) : l;
+  for(int i=start; i<end; ++i)
+  {
+    int k = m_order[i];
+    int b = bin_of(k);
+    counts[b]++;
+    boxes[b].extend(m_face_boxes[k]);
+  }
+
+  // sweep from the right to gather the area and number of faces on the right of each bin boundary
+  double right_area[nb_bins];
+  int right_count[nb_bins];
+  AlignedBox2d acc;
+  acc.setEmpty();
+  int count = 0;
+  for(int b=nb_bins-1; b>0; --b)
+  {
+    acc.extend(boxes[b]);
+    count += counts[b];
+    right_area[b] = count>0 ? acc.volume() : 0;
+    right_count[b] = count;
+  }
+
+  // then from the left to find the cheapest split
+  acc.setEmpty();
+  count = 0;
+  int best_bin = -1;
+  double best_cost = std::numeric_limits<double>::max();
+  for(int b=0; b<nb_bins-1; ++b)
+  {
+    acc.extend(boxes[b]);
+    count += counts[b];
+    if(count==0 || right_count[b+1]==0)
+      continue;
+    double cost = (acc.volume()*count + right_area[b+1]*right_count[b+1]) / node_area;
+    if(cost<best_cost)
+    {
+      best_cost = cost;
+      best_bin = b;
+    }
+  }
+  if(best_bin<0)
+    return start;
+
+  auto mid = std::partition(m_order.begin()+start, m_order.begin()+end, [&] (int k) { return bin_of(k) <= best_bin; });
+  return int(mid - m_order.begin());
 }
 
-void BVH2D::buildNode(int nodeId, int start, int end, int level, int targetCellSize, int maxDepth)
+void BVH2D::buildNode(int nodeId, int start, int end, int level, int targetCellSize, int maxDepth, std::atomic<int>* node_count)
 {
   Node& node = nodes_[nodeId];
 
-  // compute bounding box
-  Eigen::AlignedBox2d aabb;
-  aabb.setNull();
+  // compute the bounding box of the faces and of their centroids
+  Eigen::AlignedBox2d aabb, centroid_box;
+  aabb.setEmpty();
+  centroid_box.setEmpty();
   for(int i=start; i<end; ++i)
   {
-      Surface_mesh::Vertex_around_face_circulator vfc, vfc_end;
-      vfc = vfc_end = mesh_->vertices(faces_[i]);
-      do {
-           aabb.extend(m_points[(*vfc).idx()]);
-      } while (++vfc != vfc_end);
+    aabb.extend(m_face_boxes[m_order[i]]);
+    centroid_box.extend(m_centroids[m_order[i]]);
   }
   node.box = aabb;
-  Eigen::Array2d diag = aabb.max() - aabb.min();
-  // enlarge by epsilon
-  node.box.min().array() -= (diag*(2.*NumTraits<double>::epsilon()) + NumTraits<double>::epsilon());
-  node.box.max().array() += (diag*(2.*NumTraits<double>::epsilon()) + NumTraits<double>::epsilon());
+  enlarge(node.box);
 
   // stopping criteria
   if(end-start <= targetCellSize || level>=maxDepth)
@@ -213,14 +495,8 @@ void BVH2D::buildNode(int nodeId, int start, int end, int level, int targetCellS
   }
   node.is_leaf = false;
 
-  // Split along the largest dimension
-  int dim;
-  diag.maxCoeff(&dim);
-  // Split at the middle
-  float split_value = 0.5 * (node.box.max()[dim] + node.box.min()[dim]);
-
-  // Sort the faces according to the split plane
-  int mid_id = split(start, end, dim, split_value);
+  // Sort the faces according to the best split
+  int mid_id = split(start, end, centroid_box, std::max(node.box.volume(), std::numeric_limits<double>::min()));
 
   // second stopping criteria
   if(mid_id==start || mid_id==end)
@@ -233,12 +509,20 @@ void BVH2D::buildNode(int nodeId, int start, int end, int level, int targetCellS
   }
 
   // create the children
-  int child_id = node.first_child_id = nodes_.size();
-  nodes_.resize(nodes_.size()+2);
-  // node is not a valid reference anymore !
+  int child_id = node.first_child_id = node_count->fetch_add(2);
 
-  buildNode(child_id  , start, mid_id, level+1, targetCellSize, maxDepth);
-  buildNode(child_id+1, mid_id, end, level+1, targetCellSize, maxDepth);
+  // only spawn tasks for large enough subtrees
+  const int task_threshold = 4096;
+  if(mid_id-start > task_threshold)
+  {
+    #pragma omp task
+    buildNode(child_id, start, mid_id, level+1, targetCellSize, maxDepth, node_count);
+  }
+  else
+  {
+    buildNode(child_id, start, mid_id, level+1, targetCellSize, maxDepth, node_count);
+  }
+  buildNode(child_id+1, mid_id, end, level+1, targetCellSize, maxDepth, node_count);
 }
 
 }
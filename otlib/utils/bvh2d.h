@@ -10,6 +10,8 @@
 
 #include <Eigen/Geometry>
 #include <surface_mesh/Surface_mesh.h>
+#include "grid_mesh.h"
+#include <atomic>
 
 namespace otmap
 {
@@ -44,13 +46,42 @@ class BVH2D
     BVH2D();
     ~BVH2D();
 
+    /** Builds the hierarchy using a binned SAH split strategy.
+      * Subtrees are built in parallel (OpenMP tasks) when OpenMP is enabled. */
     void build(surface_mesh::Surface_mesh *mesh, int targetCellSize=4, int maxDepth=10);
 
-    surface_mesh::Surface_mesh::Face query(const Eigen::Vector2d &q, double *w) const;
+    /** Same as above but from a flat list of vertex positions and faces.
+      * Each face is given by the indices of its corners, the 4th one being -1 for triangles.
+      * The faces reported by the queries are the indices in \a faces. */
+    void build(const std::vector<Eigen::Vector2d>& points, const std::vector<Eigen::Array4i>& faces, int targetCellSize=4, int maxDepth=10);
+
+    /** Same as above for the faces of a grid mesh, without any connectivity traversal. */
+    void build(const GridMesh& mesh, int targetCellSize=4, int maxDepth=10) { build(mesh.points(), mesh.face_vertices(), targetCellSize, maxDepth); }
+
+    /** Updates the bounding boxes to the new vertex positions of \a mesh while keeping the tree structure and face ordering.
+      * \a mesh must share the connectivity of the mesh used to build the hierarchy, otherwise the hierarchy is rebuilt.
+      * If \a max_cost_ratio>0 and the SAH cost of the refitted tree exceeds \a max_cost_ratio times the cost
+      * of the tree as it was built, then the hierarchy is rebuilt from scratch.
+      * \returns false if the hierarchy has been rebuilt */
+    bool refit(surface_mesh::Surface_mesh *mesh, double max_cost_ratio=2.);
+
+    /** Same as above for new \a points of the faces used to build the hierarchy.
+      * If the number of points changed, the hierarchy is rebuilt from the same faces if they still index valid points,
+      * and is left unchanged otherwise. In both cases false is returned. */
+    bool refit(const std::vector<Eigen::Vector2d>& points, double max_cost_ratio=2.);
+    bool refit(const GridMesh& mesh, double max_cost_ratio=2.) { return refit(mesh.points(), max_cost_ratio); }
+
+    /** \returns the wall-clock time (in seconds) spent in the last call to build() */
+    double build_time() const { return m_build_time; }
+
+    /** \returns the first face containing \a q, its generalized barycentric coordinates are stored in \a w,
+      * and, if not null, the indices of its corners in \a vertex_ids (-1 for the 4th one of triangles) */
+    surface_mesh::Surface_mesh::Face query(const Eigen::Vector2d &q, double *w, int *vertex_ids = 0) const;
 
     struct Hit {
       surface_mesh::Surface_mesh::Face face_id;
       double bary_coord[4];
+      int vertex_ids[4];
     };
     void query_all(const Eigen::Vector2d &q, std::vector<Hit> &hits) const;
 
@@ -61,32 +92,50 @@ class BVH2D
 
     void intersectNode(int nodeId, const Eigen::Vector2d &target, std::vector<Hit> &hits, bool stop_at_first) const;
 
-    int split(int start, int end, int dim, float split_value);
+    int split(int start, int end, const Eigen::AlignedBox2d& centroid_box, double node_area);
+
+    double sah_cost() const;
 
-    void buildNode(int nodeId, int start, int end, int level, int targetCellSize, int maxDepth);
+    void build_hierarchy(int targetCellSize, int maxDepth);
+
+    void update_face_coords();
+
+    void buildNode(int nodeId, int start, int end, int level, int targetCellSize, int maxDepth, std::atomic<int>* node_count);
 
-    surface_mesh::Surface_mesh* mesh_;
     std::vector<Eigen::Vector2d> m_points;
     NodeList nodes_;
+    // indices of the inner nodes per depth, to refit the boxes one level at a time
+    std::vector<std::vector<int> > m_inner_levels;
     std::vector<surface_mesh::Surface_mesh::Face> faces_;
+    // per face data, faces_[i] has corners m_face_vertices[i] (the 4th one is -1 for triangles)
+    std::vector<Eigen::Array4i> m_face_vertices;
+    // the same corner positions, stored per coordinate to test packets of consecutive faces at once
+    std::vector<double> m_face_x[4], m_face_y[4];
+
+    // build-time only data, indexed by the position in the input face list
+    std::vector<int> m_order;
     std::vector<Eigen::Vector2d> m_centroids;
+    std::vector<Eigen::AlignedBox2d> m_face_boxes;
+
+    int m_target_cell_size;
+    int m_max_depth;
+    double m_build_cost;
+    double m_build_time;
 };
 
 template<typename Data>
 typename Data::value_type BVH2D::interpolate_at(const Eigen::Vector2d &q, const Data& data)
 {
   double w[4];
-  surface_mesh::Surface_mesh::Face f = query(q,w);
+  int indices[4];
+  surface_mesh::Surface_mesh::Face f = query(q,w,indices);
   if(!f.is_valid())
   {
     std::cerr << "Error: no face found. " << q.transpose() << "\n";
     return typename Data::value_type();
   }
 
-  int indices[4];
-  int j = 0;
-  for(auto v : mesh_->vertices(f))
-    indices[j++] = v.idx();
+  int j = indices[3]<0 ? 3 : 4;
 
   typename Data::value_type res = w[0]*data[indices[0]];
   for(int i=1;i<j;++i)
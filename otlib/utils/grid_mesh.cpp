@@ -0,0 +1,47 @@
+// This file is part of otmap, an optimal transport solver.
+//
+// Copyright (C) 2017-2018 Gael Guennebaud <gael.guennebaud@inria.fr>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "grid_mesh.h"
+#include "mesh_utils.h"
+
+using namespace Eigen;
+using namespace surface_mesh;
+
+namespace otmap {
+
+GridMesh::GridMesh(int grid_size)
+  : m_grid_size(grid_size), m_points((grid_size+1)*(grid_size+1))
+{
+  #pragma omp parallel for
+  for(int i=0; i<=grid_size; ++i)
+    for(int j=0; j<=grid_size; ++j)
+      m_points[vertex_index(i,j)] = regular_point(i,j);
+}
+
+GridMesh::GridMesh(int grid_size, const std::vector<Vector2d>& points)
+  : m_grid_size(grid_size), m_points(points)
+{
+  assert(int(points.size())==n_vertices());
+}
+
+std::vector<Array4i> GridMesh::face_vertices() const
+{
+  std::vector<Array4i> faces(n_faces());
+  #pragma omp parallel for
+  for(int f=0; f<n_faces(); ++f)
+    faces[f] = face_vertices(f);
+  return faces;
+}
+
+void GridMesh::to_surface_mesh(Surface_mesh& mesh) const
+{
+  generate_quad_mesh(m_grid_size+1, m_grid_size+1, mesh);
+  mesh.points() = m_points;
+}
+
+} // namespace otmap
@@ -0,0 +1,69 @@
+// This file is part of otmap, an optimal transport solver.
+//
+// Copyright (C) 2017-2018 Gael Guennebaud <gael.guennebaud@inria.fr>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <surface_mesh/Surface_mesh.h>
+#include <Eigen/Core>
+#include <vector>
+
+namespace otmap {
+
+/** Quad mesh with the connectivity of the regular grid of grid_size x grid_size cells over [0,1]^2.
+  * Only the vertex positions are stored, the connectivity is implicit:
+  *  - the vertex (i,j) has index j+i*(grid_size+1) and is initially located at (i,j)/grid_size,
+  *  - the face (i,j) has index j+i*grid_size and corners (i,j), (i+1,j), (i+1,j+1), (i,j+1).
+  * This is the same numbering as generate_quad_mesh(grid_size+1,grid_size+1) and TransportMap.
+  */
+class GridMesh
+{
+public:
+
+  GridMesh() : m_grid_size(0) {}
+
+  /** Creates the regular grid of \a grid_size x \a grid_size cells */
+  explicit GridMesh(int grid_size);
+
+  /** Creates a grid of \a grid_size x \a grid_size cells whose vertices are located at \a points */
+  GridMesh(int grid_size, const std::vector<Eigen::Vector2d>& points);
+
+  int grid_size() const { return m_grid_size; }
+  int n_vertices() const { return (m_grid_size+1)*(m_grid_size+1); }
+  int n_faces() const { return m_grid_size*m_grid_size; }
+
+  int vertex_index(int i, int j) const { return j+i*(m_grid_size+1); }
+  int face_index(int i, int j) const { return j+i*m_grid_size; }
+
+  /** \returns the indices of the 4 corners of the face \a f */
+  Eigen::Array4i face_vertices(int f) const
+  {
+    int i = f/m_grid_size;
+    int j = f%m_grid_size;
+    int v = vertex_index(i,j);
+    return Eigen::Array4i(v, v+m_grid_size+1, v+m_grid_size+2, v+1);
+  }
+
+  /** \returns the corners of all the faces, as expected by BVH2D::build */
+  std::vector<Eigen::Array4i> face_vertices() const;
+
+  /** \returns the position of the vertex (i,j) in the regular grid */
+  Eigen::Vector2d regular_point(int i, int j) const { return Eigen::Vector2d(i,j) * (1./double(m_grid_size)); }
+
+  const Eigen::Vector2d& position(int v) const { return m_points[v]; }
+  std::vector<Eigen::Vector2d>& points() { return m_points; }
+  const std::vector<Eigen::Vector2d>& points() const { return m_points; }
+
+  /** Builds the equivalent halfedge mesh, e.g., for export or for algorithms supporting arbitrary meshes only */
+  void to_surface_mesh(surface_mesh::Surface_mesh& mesh) const;
+
+protected:
+  int m_grid_size;
+  std::vector<Eigen::Vector2d> m_points;
+};
+
+} // namespace otmap
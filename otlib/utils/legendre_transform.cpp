@@ -0,0 +1,97 @@
+// This file is part of otmap, an optimal transport solver.
+//
+// Copyright (C) 2017-2018 Gael Guennebaud <gael.guennebaud@inria.fr>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "legendre_transform.h"
+#include <vector>
+
+using namespace Eigen;
+
+namespace otmap {
+
+void legendre_transform_1d(const double* x, const double* f, int n, const double* s, int m, double* fs, int* arg)
+{
+  // lower convex hull of the samples (x_k,f_k)
+  std::vector<int> hull(n);
+  int h = 0;
+  for(int k=0; k<n; ++k)
+  {
+    while(h>=2)
+    {
+      int a = hull[h-2];
+      int b = hull[h-1];
+      // remove b if it lies above the segment [a,k]
+      if((f[b]-f[a])*(x[k]-x[b]) >= (f[k]-f[b])*(x[b]-x[a]))
+        --h;
+      else
+        break;
+    }
+    hull[h++] = k;
+  }
+
+  // the slopes of the hull are increasing, so is s
+  int c = 0;
+  for(int j=0; j<m; ++j)
+  {
+    while(c<h-1 && (f[hull[c+1]]-f[hull[c]]) <= s[j]*(x[hull[c+1]]-x[hull[c]]))
+      ++c;
+    int k = hull[c];
+    fs[j] = s[j]*x[k] - f[k];
+    if(arg)
+      arg[j] = k;
+  }
+}
+
+void legendre_transform_2d(const VectorXd& x0, const VectorXd& x1, const MatrixXd& f,
+                           const VectorXd& s0, const VectorXd& s1, MatrixXd& fs,
+                           MatrixXi* arg0, MatrixXi* arg1)
+{
+  int n0 = x0.size();
+  int n1 = x1.size();
+  int m0 = s0.size();
+  int m1 = s1.size();
+
+  // first pass along x1:  g(i,l) = max_j s1_l x1_j - f(i,j)
+  MatrixXd g(n0,m1);
+  MatrixXi a1(n0,m1);
+  #pragma omp parallel
+  {
+    VectorXd row(n1), g_row(m1);
+    VectorXi a_row(m1);
+    #pragma omp for
+    for(int i=0; i<n0; ++i)
+    {
+      row = f.row(i).transpose();
+      legendre_transform_1d(x1.data(), row.data(), n1, s1.data(), m1, g_row.data(), a_row.data());
+      g.row(i) = g_row.transpose();
+      a1.row(i) = a_row.transpose();
+    }
+  }
+
+  // second pass along x0:  fs(k,l) = max_i s0_k x0_i - (-g(i,l))
+  fs.resize(m0,m1);
+  if(arg0) arg0->resize(m0,m1);
+  if(arg1) arg1->resize(m0,m1);
+  #pragma omp parallel
+  {
+    VectorXd col(n0);
+    VectorXi a_col(m0);
+    #pragma omp for
+    for(int l=0; l<m1; ++l)
+    {
+      col = -g.col(l);
+      legendre_transform_1d(x0.data(), col.data(), n0, s0.data(), m0, fs.col(l).data(), a_col.data());
+      for(int k=0; k<m0; ++k)
+      {
+        if(arg0) (*arg0)(k,l) = a_col(k);
+        if(arg1) (*arg1)(k,l) = a1(a_col(k),l);
+      }
+    }
+  }
+}
+
+} // namespace otmap
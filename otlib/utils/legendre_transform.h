@@ -0,0 +1,35 @@
+// This file is part of otmap, an optimal transport solver.
+//
+// Copyright (C) 2017-2018 Gael Guennebaud <gael.guennebaud@inria.fr>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <Eigen/Core>
+
+namespace otmap {
+
+/** Computes the discrete Legendre-Fenchel transform of the 1D function sampled as f(x_k), k=0..n-1,
+  * at the slopes s_j, j=0..m-1:
+  *   fs(s_j) = max_k s_j x_k - f(x_k)
+  * Both \a x and \a s must be sorted in increasing order.
+  * This is the linear-time algorithm of Lucet: the lower convex hull of the samples is
+  * computed first, and then traversed while iterating over the slopes, thus the complexity is O(n+m).
+  * If \a arg is not null, then the index k of the maximizer is stored in arg[j].
+  */
+void legendre_transform_1d(const double* x, const double* f, int n, const double* s, int m, double* fs, int* arg = 0);
+
+/** Computes the discrete Legendre-Fenchel transform of the function \a f sampled on the regular grid x0 x x1:
+  *   fs(k,l) = max_{i,j} s0_k x0_i + s1_l x1_j - f(i,j)
+  * The transform is separable and computed by two passes of legendre_transform_1d,
+  * first along x1 in parallel over the rows of \a f, and then along x0 in parallel over its columns.
+  * If \a arg0 and \a arg1 are not null, then they receive the maximizer (i,j) of each slope (k,l).
+  */
+void legendre_transform_2d(const Eigen::VectorXd& x0, const Eigen::VectorXd& x1, const Eigen::MatrixXd& f,
+                           const Eigen::VectorXd& s0, const Eigen::VectorXd& s1, Eigen::MatrixXd& fs,
+                           Eigen::MatrixXi* arg0 = 0, Eigen::MatrixXi* arg1 = 0);
+
+} // namespace otmap
@@ -16,17 +16,24 @@ namespace otmap {
 
 // works for any quads, but q must be inside the quad
 bool bilinear_coordinates_in_quad(const Eigen::Vector2d& q, const Eigen::Vector2d *p, double &u, double &v)
+{
+  double A[4] = { signed_area(q,p[0],p[1]),
+                  signed_area(q,p[1],p[2]),
+                  signed_area(q,p[2],p[3]),
+                  signed_area(q,p[3],p[0]) };
+  return bilinear_coordinates_from_areas(A, signed_area(q,p[3],p[1]), signed_area(q,p[0],p[2]), u, v);
+}
+
+bool bilinear_coordinates_from_areas(const double* A, double B0, double B1, double &u, double &v)
 {
   using std::abs;
   using std::sqrt;
 
-  double A0 = (signed_area(q,p[0],p[1]));
-  double A1 = (signed_area(q,p[1],p[2]));
-  double A2 = (signed_area(q,p[2],p[3]));
-  double A3 = (signed_area(q,p[3],p[0]));
-  double B0 = (signed_area(q,p[3],p[1]));
-  double B1 = (signed_area(q,p[0],p[2]));
-  double B3 = (signed_area(q,p[2],p[0]));
+  double A0 = A[0];
+  double A1 = A[1];
+  double A2 = A[2];
+  double A3 = A[3];
+  double B3 = -B1;
   double D = B0*B0+B1*B1+2*A0*A2+2*A1*A3;
   if(D<0)
     return false;
@@ -73,52 +80,146 @@ bool inside_quad(const Vector2d& q, const Vector2d *p)
   return false;
 }
 
+// Lane-wise version of bilinear_coordinates_in_quad.
+// The arithmetic is performed on all lanes at once, and the branches are replaced by per-lane selections.
+static int bilinear_coordinates_in_quad_lanes(const Array4d& qx, const Array4d& qy, const Array4d* px, const Array4d* py, Array4d& u, Array4d& v)
+{
+  double zero = 4*std::numeric_limits<double>::min();
+  double eps = std::sqrt(std::numeric_limits<double>::epsilon());
+
+  // same as signed_area(q,p[a],p[b])
+  auto area = [&] (int a, int b) -> Array4d {
+    return 0.5 * ((px[a]-qx)*(py[b]-qy) - (py[a]-qy)*(px[b]-qx));
+  };
+
+  Array4d A0 = area(0,1);
+  Array4d A1 = area(1,2);
+  Array4d A2 = area(2,3);
+  Array4d A3 = area(3,0);
+  Array4d B0 = area(3,1);
+  Array4d B1 = area(0,2);
+  Array4d B3 = area(2,0);
+  Array4d D = B0*B0+B1*B1+2*A0*A2+2*A1*A3;
+  Array4d sqrtD = D.max(0.).sqrt();
+
+  // both roots
+  Array4d v0 = 2*A0/(2*A0-B0-B1+sqrtD);
+  Array4d u0 = 2*A3/(2*A3-B3-B0+sqrtD);
+  Array4d v1 = 2*A0/(2*A0-B0-B1-sqrtD);
+  Array4d u1 = 2*A3/(2*A3-B3-B0-sqrtD);
+
+  auto snap = [eps] (double x) {
+    x = std::abs(x)<eps ? 0. : x;
+    return std::abs(x-1.)<eps ? 1. : x;
+  };
+
+  int mask = 0;
+  for(int k=0; k<4; ++k)
+  {
+    double vk  = snap(std::abs(A0(k))<=zero ? 0. : v0(k));
+    double uk  = snap(std::abs(A3(k))<=zero ? 0. : u0(k));
+    double vk1 = snap(std::abs(A0(k))<=zero ? 0. : v1(k));
+    double uk1 = snap(std::abs(A3(k))<=zero ? 0. : u1(k));
+    bool ok  = uk >=0. && vk >=0. && uk <=1. && vk <=1.;
+    bool ok1 = uk1>=0. && vk1>=0. && uk1<=1. && vk1<=1.;
+    u(k) = ok ? uk : uk1;
+    v(k) = ok ? vk : vk1;
+    mask |= int(D(k)>=0. && (ok || ok1)) << k;
+  }
+  return mask;
+}
+
+// Lane-wise version of inside_quad
+static int inside_quad_lanes(const Array4d& qx, const Array4d& qy, const Array4d* px, const Array4d* py)
+{
+  double eps = 1e-8;
+  // same as testing the coordinates returned by bilinear_coordinates_in_triangle(q,p[a],p[b],p[c])
+  auto inside_triangle = [&] (int a, int b, int c) {
+    Array4d q2x = qx-px[c],    q2y = qy-py[c];
+    Array4d eux = px[b]-px[c], euy = py[b]-py[c];
+    Array4d evx = px[a]-px[c], evy = py[a]-py[c];
+    Array4d area2 = evx*euy - evy*eux;
+    Array4d s = (q2x*euy - q2y*eux)/area2;
+    Array4d t = (evx*q2y - evy*q2x)/area2;
+    int mask = 0;
+    for(int k=0; k<4; ++k)
+      mask |= int(s(k)>=-eps && t(k)>=-eps && s(k)+t(k)<=1.+eps) << k;
+    return mask;
+  };
+  return inside_triangle(0,1,2) | inside_triangle(0,2,3);
+}
+
+int bilinear_coordinates_in_quad4(const Array4d& qx, const Array4d& qy, const Vector2d *p, Array4d& u, Array4d& v)
+{
+  Array4d px[4], py[4];
+  for(int k=0; k<4; ++k)
+  {
+    px[k].setConstant(p[k].x());
+    py[k].setConstant(p[k].y());
+  }
+  return bilinear_coordinates_in_quad_lanes(qx, qy, px, py, u, v);
+}
+
+int bilinear_coordinates_in_quad4(const Vector2d& q, const Array4d *px, const Array4d *py, Array4d& u, Array4d& v)
+{
+  return bilinear_coordinates_in_quad_lanes(Array4d::Constant(q.x()), Array4d::Constant(q.y()), px, py, u, v);
+}
+
+int inside_quad4(const Array4d& qx, const Array4d& qy, const Vector2d *p)
+{
+  Array4d px[4], py[4];
+  for(int k=0; k<4; ++k)
+  {
+    px[k].setConstant(p[k].x());
+    py[k].setConstant(p[k].y());
+  }
+  return inside_quad_lanes(qx, qy, px, py);
+}
+
+int inside_quad4(const Vector2d& q, const Array4d *px, const Array4d *py)
+{
+  return inside_quad_lanes(Array4d::Constant(q.x()), Array4d::Constant(q.y()), px, py);
+}
+
 bool bilinear_coordinates_in_quad(const Eigen::Vector2d& q, const Eigen::Vector2d *p, Eigen::Ref<Eigen::Vector4d> w)
 {
-  double eps = 4*(std::numeric_limits<double>::epsilon());
   double u,v;
   if(!bilinear_coordinates_in_quad(q, p, u, v))
     return false;
+  w = quad_bilinear_weights(u, v);
+  return true;
+}
+
+Eigen::Vector4d quad_bilinear_weights(double u, double v)
+{
+  double eps = 4*(std::numeric_limits<double>::epsilon());
+  Vector4d w;
   w << (1.-u)*(1-v), (u)*(1.-v), (u)*(v), (1.-u)*(v);
   for(int k=0;k<4;++k) {
     if(std::abs(w(k))<=eps) w(k) = 0;
     else if(std::abs(w(k)-1.)<=eps) w(k) = 1;
   }
-  return true;
+  return w;
 }
 
 void generate_quad_mesh(int m, int n, Surface_mesh &mesh, bool inclusive)
 {
   using namespace surface_mesh;
-  using namespace Eigen;
-
-  mesh.clear();
 
-  mesh.reserve(m*n, (m-1)*n+ m*(n-1), (m-1)*(n-1));
+  // the vertex (i,j) has index j+i*m
+  mesh.build_quad_grid(m, n);
 
   double dx = 1./double(n-1);
   double dy = 1./double(m-1);
 
-  Eigen::Array<Surface_mesh::Vertex,Dynamic,Dynamic> ids(m,n);
+  std::vector<Point>& points = mesh.points();
+  #pragma omp parallel for
   for(int i=0;i<n;++i)
     for(int j=0;j<m;++j)
       if(inclusive)
-        ids(i,j) = mesh.add_vertex(Point((i+0.5)/double(n),(j+0.5)/double(m)));
+        points[j+i*m] = Point((i+0.5)/double(n),(j+0.5)/double(m));
       else
-        ids(i,j) = mesh.add_vertex(Point(double(i)*dx, double(j)*dy));
-
-
-  for(int i=0; i<n-1; ++i) {
-    for(int j=0; j<m-1; ++j) {
-      Surface_mesh::Vertex v0,v1,v2,v3;
-      v0 = ids(i+0,j+0);
-      v1 = ids(i+1,j+0);
-      v2 = ids(i+1,j+1);
-      v3 = ids(i+0,j+1);
-
-      mesh.add_quad(v0, v1, v2, v3);
-    }
-  }
+        points[j+i*m] = Point(double(i)*dx, double(j)*dy);
 }
 
 void
@@ -131,12 +232,10 @@ prune_empty_faces(Surface_mesh &mesh, VectorXd density)
     for(int i=nf-1; i>=0; i--)
       density(i) = density(i/2);
   }
+  std::vector<bool> empty(nf);
   for(int i=0; i<nf;++i)
-  {
-    if(density(i)==0)
-      mesh.delete_face(Surface_mesh::Face(i));
-  }
-  mesh.garbage_collection();
+    empty[i] = density(i)==0;
+  mesh.delete_faces(empty);
 }
 
 }
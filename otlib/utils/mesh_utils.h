@@ -27,8 +27,26 @@ inline Eigen::Vector2d bilinear_coordinates_in_triangle(const Eigen::Vector2d& q
 bool bilinear_coordinates_in_quad(const Eigen::Vector2d& q, const Eigen::Vector2d *p, double &u, double &v);
 bool bilinear_coordinates_in_quad(const Eigen::Vector2d& q, const Eigen::Vector2d *p, Eigen::Ref<Eigen::Vector4d> w);
 
+// Same as bilinear_coordinates_in_quad but from the signed areas A[k] = signed_area(q,p[k],p[(k+1)%4]),
+// B0 = signed_area(q,p[3],p[1]), and B1 = signed_area(q,p[0],p[2]).
+// Since the areas are affine in q, this permits to evaluate them incrementally.
+bool bilinear_coordinates_from_areas(const double* A, double B0, double B1, double &u, double &v);
+
+// returns the weights of the 4 corners of a quad for the bilinear coordinates (u,v)
+Eigen::Vector4d quad_bilinear_weights(double u, double v);
+
 bool inside_quad(const Eigen::Vector2d& q, const Eigen::Vector2d *p);
 
+// Vectorized variants processing 4 lanes at once, either the 4 points (qx,qy) against the quad p,
+// or the point q against the 4 quads whose k-th corners are (px[k],py[k]).
+// bilinear_coordinates_in_quad4 returns the bitmask of the lanes for which the bilinear coordinates
+// are valid and within [0,1]^2, u and v are undefined for the other lanes.
+// inside_quad4 returns the bitmask of the lanes for which inside_quad would return true.
+int bilinear_coordinates_in_quad4(const Eigen::Array4d& qx, const Eigen::Array4d& qy, const Eigen::Vector2d *p, Eigen::Array4d& u, Eigen::Array4d& v);
+int bilinear_coordinates_in_quad4(const Eigen::Vector2d& q, const Eigen::Array4d *px, const Eigen::Array4d *py, Eigen::Array4d& u, Eigen::Array4d& v);
+int inside_quad4(const Eigen::Array4d& qx, const Eigen::Array4d& qy, const Eigen::Vector2d *p);
+int inside_quad4(const Eigen::Vector2d& q, const Eigen::Array4d *px, const Eigen::Array4d *py);
+
 // generate a regular quad mesh
 void generate_quad_mesh(int m, int n, surface_mesh::Surface_mesh& mesh, bool inclusive = false);
 
@@ -28,6 +28,8 @@
 #include "rasterizer.h"
 #include "mesh_utils.h"
 #include <array>
+#include <limits>
+#include <vector>
 
 using namespace Eigen;
 using namespace surface_mesh;
@@ -82,64 +84,76 @@ struct Vert {
 };
 
 
-//This function takes in 3 vertices in the [0,1]^2 domain, generate fragments, and call fragment_shader for each.
-template<class VertexType,class FragShader>
-void rasterize_face(int rows, int cols, std::array<VertexType,3> verts, FragShader fragment_shader)
+// Computes the range [ibb_ul,ibb_lr) of pixels covered by the bounding box of the face verts, clamped to the image.
+template<class VertexType, std::size_t N>
+void face_pixel_bounds(int rows, int cols, const std::array<VertexType,N>& verts, Eigen::Array2i& ibb_ul, Eigen::Array2i& ibb_lr)
 {
-  using Vector3 = Eigen::Vector3d;
-  using Array2i = Eigen::Array2i;
   using Array2  = Eigen::Array2d;
 
-  Array2 ss1 = verts[0];
-  Array2 ss2 = verts[1];
-  Array2 ss3 = verts[2];
-
-  // calculate the bounding box of the triangle in screen space floating point.
-  Array2 bb_ul = ss1.min(ss2).min(ss3);
-  Array2 bb_lr = ss1.max(ss2).max(ss3);
-  Array2i isz(cols,rows);
+  // calculate the bounding box of the face in screen space floating point.
+  Array2 bb_ul = Array2(verts[0]);
+  Array2 bb_lr = bb_ul;
+  for(std::size_t k=1; k<N; ++k)
+  {
+    bb_ul = bb_ul.min(Array2(verts[k]));
+    bb_lr = bb_lr.max(Array2(verts[k]));
+  }
+  Eigen::Array2i isz(cols,rows);
 
   // convert bounding box to fixed point.
   // and clamp the bounding box to the framebuffer size if necessary
-  Array2i ibb_ul = (bb_ul*isz.cast<double>()).cast<int>().max(Array2i(0,0));
-  Array2i ibb_lr = ((bb_lr*isz.cast<double>()).cast<int>()+1).min(isz); //add one pixel of coverage
+  ibb_ul = (bb_ul*isz.cast<double>()).cast<int>().max(Eigen::Array2i(0,0));
+  ibb_lr = ((bb_lr*isz.cast<double>()).cast<int>()+1).min(isz); //add one pixel of coverage
+}
+
+//This function takes in 3 vertices in the [0,1]^2 domain, generate fragments within the pixel range [ibb_ul,ibb_lr), and call fragment_shader for each.
+template<class VertexType,class FragShader>
+void rasterize_face(int rows, int cols, std::array<VertexType,3> verts, FragShader fragment_shader,
+                    const Eigen::Array2i& ibb_ul, const Eigen::Array2i& ibb_lr)
+{
+  using Vector2 = Eigen::Vector2d;
+
+  Vector2 ss1 = verts[0];
+  Vector2 ss2 = verts[1];
+  Vector2 ss3 = verts[2];
+  BarycentricTransform bt(ss1,ss2,ss3);
 
-  BarycentricTransform bt(ss1.matrix(),ss2.matrix(),ss3.matrix());
+  // The barycentric coordinates are the normalized edge functions of the triangle,
+  // they are evaluated at the first pixel of each row, and then incrementally updated along the row.
+  Vector2 dx(1./double(cols), 0.);
+  Eigen::Vector3d db = bt(dx) - bt(Vector2::Zero());
 
   //for all the pixels in the bounding box
   for(int y=ibb_ul[1];y<ibb_lr[1];y++)
-  for(int x=ibb_ul[0];x<ibb_lr[0];x++)
   {
-    Array2 ssc(x,y);
-    ssc = (ssc+0.5)/isz.cast<double>(); // move pixel to relative coordinates
-
-    // Compute barycentric coordinates of the pixel center
-    Vector3 bary = bt(ssc);
-
-    //if the pixel has valid barycentric coordinates, the pixel is in the triangle
-    if((bary.array() <= 1.0f).all() && (bary.array() >= 0.0f).all())
+    // move pixel to relative coordinates
+    Eigen::Vector3d bary = bt(Vector2((ibb_ul[0]+0.5)/double(cols), (y+0.5)/double(rows)));
+    for(int x=ibb_ul[0];x<ibb_lr[0];x++, bary+=db)
     {
-      //interpolate varying parameters
-      VertexType v;
-      for(int i=0;i<3;i++)
+      //if the pixel has valid barycentric coordinates, the pixel is in the triangle
+      if((bary.array() <= 1.0f).all() && (bary.array() >= 0.0f).all())
       {
-        VertexType vt = verts[0];
-        vt *= bary[i];
-        v += vt;
+        //interpolate varying parameters
+        VertexType v;
+        for(int i=0;i<3;i++)
+        {
+          VertexType vt = verts[0];
+          vt *= bary[i];
+          v += vt;
+        }
+        //call the fragment processor
+        fragment_shader(x,y,v);
       }
-      //call the fragment processor
-      fragment_shader(x,y,v);
     }
   }
 }
 
 
-//This function takes in a quad as 4 vertices in the [0,1]^2 domain, generate fragments, and call fragment_shader for each.
+//This function takes in a quad as 4 vertices in the [0,1]^2 domain, generate fragments within the pixel range [ibb_ul,ibb_lr), and call fragment_shader for each.
 template<class VertexType,class FragShader>
-void rasterize_face(int rows, int cols, std::array<VertexType,4> verts, FragShader fragment_shader)
+void rasterize_face(int rows, int cols, std::array<VertexType,4> verts, FragShader fragment_shader,
+                    const Eigen::Array2i& ibb_ul, const Eigen::Array2i& ibb_lr)
 {
-  using Array2i = Eigen::Array2i;
-  using Array2  = Eigen::Array2d;
   using Vector2  = Eigen::Vector2d;
 
   Vector2 ss[4];
@@ -148,28 +162,54 @@ void rasterize_face(int rows, int cols, std::array<VertexType,4> verts, FragShad
   ss[2] = verts[2];
   ss[3] = verts[3];
 
-  // calculate the bounding box of the triangle in screen space floating point.
-  Array2 bb_ul = ss[0].cwiseMin(ss[1]).cwiseMin(ss[2]).cwiseMin(ss[3]);
-  Array2 bb_lr = ss[0].cwiseMax(ss[1]).cwiseMax(ss[2]).cwiseMax(ss[3]);
-  Array2i isz(cols,rows);
+  // The signed areas A_k=signed_area(q,ss[k],ss[k+1]) and B_k involved in the bilinear inversion are affine in q,
+  // so they are evaluated at the first pixel of the row span, and then incrementally updated along the row.
+  auto area_dx = [&] (int a, int b) { return 0.5*(ss[a].y()-ss[b].y())/double(cols); };
+  const double dA[4] = { area_dx(0,1), area_dx(1,2), area_dx(2,3), area_dx(3,0) };
+  const double dB0 = area_dx(3,1);
+  const double dB1 = area_dx(0,2);
 
-  // convert bounding box to fixed point.
-  // and clamp the bounding box to the framebuffer size if necessary
-  Array2i ibb_ul = (bb_ul*isz.cast<double>()).cast<int>().max(Array2i(0,0));
-  Array2i ibb_lr = ((bb_lr*isz.cast<double>()).cast<int>()+1).min(isz); //add one pixel of coverage
-
-  //for all the pixels in the bounding box
   for(int y=ibb_ul[1];y<ibb_lr[1];y++)
-  for(int x=ibb_ul[0];x<ibb_lr[0];x++)
   {
-    Array2 ssc(x,y);
-    ssc = (ssc+0.5)/isz.cast<double>(); // move pixel to relative coordinates
+    double yc = (y+0.5)/double(rows);
 
-    //if the pixel has valid barycentric coordinates, the pixel is in the triangle
-    Eigen::Vector4d bary;
-    bilinear_coordinates_in_quad(ssc, ss, bary);
-    if((bary.array() <= 1.0f).all() && (bary.array() >= 0.0f).all())
+    // horizontal extent of the row within the convex hull of the corners, which contains the bilinear patch
+    double xmin = std::numeric_limits<double>::infinity();
+    double xmax = -xmin;
+    for(int a=0; a<4; ++a)
+      for(int b=a+1; b<4; ++b)
+      {
+        if((ss[a].y()<yc && ss[b].y()<yc) || (ss[a].y()>yc && ss[b].y()>yc))
+          continue;
+        double dy = ss[b].y()-ss[a].y();
+        double xc = dy==0. ? ss[a].x() : ss[a].x() + (yc-ss[a].y())/dy*(ss[b].x()-ss[a].x());
+        xmin = std::min(xmin, dy==0. ? std::min(ss[a].x(),ss[b].x()) : xc);
+        xmax = std::max(xmax, dy==0. ? std::max(ss[a].x(),ss[b].x()) : xc);
+      }
+    if(!(xmin<=xmax))
+      continue;
+    // pixels whose center lies in [xmin,xmax], with one pixel of margin for round-off errors
+    int x0 = std::max<double>(ibb_ul[0], std::floor(xmin*cols-0.5));
+    int x1 = std::min<double>(ibb_lr[0], std::ceil(xmax*cols-0.5)+1);
+    if(x0>=x1)
+      continue;
+
+    Vector2 q((x0+0.5)/double(cols), yc);
+    double A0[4] = { signed_area(q,ss[0],ss[1]), signed_area(q,ss[1],ss[2]), signed_area(q,ss[2],ss[3]), signed_area(q,ss[3],ss[0]) };
+    double B00 = signed_area(q,ss[3],ss[1]);
+    double B10 = signed_area(q,ss[0],ss[2]);
+
+    for(int x=x0; x<x1; ++x)
     {
+      double t = x-x0;
+      double A[4] = { A0[0]+t*dA[0], A0[1]+t*dA[1], A0[2]+t*dA[2], A0[3]+t*dA[3] };
+      double bu, bv;
+
+      //if the pixel has valid bilinear coordinates, the pixel is in the quad
+      if(!bilinear_coordinates_from_areas(A, B00+t*dB0, B10+t*dB1, bu, bv) || bu<0. || bv<0. || bu>1. || bv>1.)
+        continue;
+      Eigen::Vector4d bary = quad_bilinear_weights(bu, bv);
+
       //interpolate varying parameters
       VertexType v;
       for(int i=0;i<4;i++)
@@ -184,11 +224,272 @@ void rasterize_face(int rows, int cols, std::array<VertexType,4> verts, FragShad
   }
 }
 
+// Rasterizes the faces given by the indices of their corners in vertices (the 4th one is -1 for triangles,
+// and faces whose first index is -1 are skipped),
+// and calls fragment_shader(f,x,y,v) for each generated fragment of each face f.
+// The faces are binned to square tiles of the image, and the tiles are processed in parallel.
+// Within a tile, the faces are processed in order, so that overlapping faces produce the same image as a serial rasterization.
+template<class VertexType,class FragShader>
+void rasterize_faces(int rows, int cols, const std::vector<Array4i>& faces, const std::vector<VertexType>& vertices, FragShader fragment_shader)
+{
+  const int tile_size = 32;
+  int tiles_x = (cols+tile_size-1)/tile_size;
+  int tiles_y = (rows+tile_size-1)/tile_size;
+  int nf = faces.size();
+
+  auto corners3 = [&] (int f) {
+    return std::array<VertexType,3>{vertices[faces[f](0)], vertices[faces[f](1)], vertices[faces[f](2)]};
+  };
+  auto corners4 = [&] (int f) {
+    return std::array<VertexType,4>{vertices[faces[f](0)], vertices[faces[f](1)], vertices[faces[f](2)], vertices[faces[f](3)]};
+  };
+
+  auto rasterize = [&] (int f, const Array2i& ibb_ul, const Array2i& ibb_lr) {
+    auto shader = [&] (int x, int y, const VertexType& v) { fragment_shader(f,x,y,v); };
+    if(faces[f](3)<0) rasterize_face(rows, cols, corners3(f), shader, ibb_ul, ibb_lr);
+    else              rasterize_face(rows, cols, corners4(f), shader, ibb_ul, ibb_lr);
+  };
+
+  if(Eigen::nbThreads()==1)
+  {
+    // binning would be pure overhead
+    for(int f=0; f<nf; ++f)
+    {
+      if(faces[f](0)<0)
+        continue;
+      Array2i ibb_ul, ibb_lr;
+      if(faces[f](3)<0) face_pixel_bounds(rows, cols, corners3(f), ibb_ul, ibb_lr);
+      else              face_pixel_bounds(rows, cols, corners4(f), ibb_ul, ibb_lr);
+      rasterize(f, ibb_ul, ibb_lr);
+    }
+    return;
+  }
+
+  // pixel bounds of each face as [ul,lr)
+  std::vector<Array4i> bounds(nf);
+  #pragma omp parallel for
+  for(int f=0; f<nf; ++f)
+  {
+    Array2i ibb_ul, ibb_lr;
+    if(faces[f](0)<0)
+    {
+      bounds[f].setZero();
+      continue;
+    }
+    if(faces[f](3)<0) face_pixel_bounds(rows, cols, corners3(f), ibb_ul, ibb_lr);
+    else              face_pixel_bounds(rows, cols, corners4(f), ibb_ul, ibb_lr);
+    bounds[f] << ibb_ul, ibb_lr;
+  }
+
+  // bin the faces
+  std::vector<std::vector<int> > bins(tiles_x*tiles_y);
+  for(int f=0; f<nf; ++f)
+  {
+    if((bounds[f].tail<2>()<=bounds[f].head<2>()).any())
+      continue;
+    Array2i t0 = bounds[f].head<2>()/tile_size;
+    Array2i t1 = (bounds[f].tail<2>()-1)/tile_size;
+    for(int ty=t0.y(); ty<=t1.y(); ++ty)
+      for(int tx=t0.x(); tx<=t1.x(); ++tx)
+        bins[tx+ty*tiles_x].push_back(f);
+  }
+
+  #pragma omp parallel for schedule(dynamic)
+  for(int t=0; t<tiles_x*tiles_y; ++t)
+  {
+    Array2i clip_ul = Array2i(t%tiles_x, t/tiles_x)*tile_size;
+    Array2i clip_lr = (clip_ul+tile_size).min(Array2i(cols,rows));
+    for(int f : bins[t])
+      rasterize(f, bounds[f].head<2>().max(clip_ul), bounds[f].tail<2>().min(clip_lr));
+  }
+}
+
 
-void rasterize_image(const Surface_mesh &mesh, const VectorXd &density_per_Face, MatrixXd& img, RasterImageOption opt)
+// A small convex or non-convex polygon, as the intersection of a quad with a pixel has at most 8 vertices
+struct ClipPolygon
+{
+  Vector2d p[12];
+  int n = 0;
+
+  // clips the polygon against the half-plane s*p(axis) <= s*c
+  ClipPolygon clipped(int axis, double c, double s) const
+  {
+    ClipPolygon res;
+    for(int k=0; k<n; ++k)
+    {
+      const Vector2d& a = p[k];
+      const Vector2d& b = p[(k+1)%n];
+      double da = s*(a(axis)-c);
+      double db = s*(b(axis)-c);
+      if(da<=0)
+        res.p[res.n++] = a;
+      if((da<0 && db>0) || (da>0 && db<0))
+      {
+        Vector2d q = a + (da/(da-db))*(b-a);
+        q(axis) = c;
+        res.p[res.n++] = q;
+      }
+    }
+    return res;
+  }
+
+  double area() const
+  {
+    double a = 0;
+    for(int k=0; k<n; ++k)
+    {
+      const Vector2d& u = p[k];
+      const Vector2d& v = p[(k+1)%n];
+      a += u.x()*v.y() - u.y()*v.x();
+    }
+    return 0.5*std::abs(a);
+  }
+};
+
+// Converts the polygon given by corners in the [0,1]^2 domain to pixel units, and computes its pixel bounds as [ul,lr).
+// \returns false if the polygon does not overlap the image.
+static bool coverage_polygon(const Vector2d* corners, int nb_corners, int rows, int cols, ClipPolygon& poly, Array2i& ibb_ul, Array2i& ibb_lr)
+{
+  poly.n = nb_corners;
+  for(int k=0; k<nb_corners; ++k)
+    poly.p[k] = corners[k].cwiseProduct(Vector2d(cols,rows));
+
+  Array2d bb_ul = poly.p[0], bb_lr = poly.p[0];
+  for(int k=1; k<nb_corners; ++k)
+  {
+    bb_ul = bb_ul.min(poly.p[k].array());
+    bb_lr = bb_lr.max(poly.p[k].array());
+  }
+  if(!((bb_ul.isFinite()).all() && (bb_lr.isFinite()).all()))
+    return false;
+  ibb_ul = bb_ul.floor().max(0.).min(Array2d(cols,rows)).cast<int>();
+  ibb_lr = bb_lr.ceil().max(0.).min(Array2d(cols,rows)).cast<int>();
+  return (ibb_ul<ibb_lr).all();
+}
+
+// Accumulates into img the exact integral over each pixel of the constant density value (per unit area of [0,1]^2)
+// over the polygon poly given in pixel units, only the pixels within [clip_ul,clip_lr) are written.
+template<typename ImageType>
+static void rasterize_face_coverage(const ClipPolygon& poly, double value, const Array2i& clip_ul, const Array2i& clip_lr, ImageType& img)
 {
-  // create indexed-face-set
-  auto& vpositions = mesh.get_vertex_property<Point>("v:point").vector();
+  double ymin = poly.p[0].y(), ymax = ymin;
+  for(int k=1; k<poly.n; ++k)
+  {
+    ymin = std::min(ymin, poly.p[k].y());
+    ymax = std::max(ymax, poly.p[k].y());
+  }
+  int y0 = std::max(clip_ul.y(), int(std::floor(ymin)));
+  int y1 = std::min(clip_lr.y(), int(std::ceil(ymax)));
+
+  for(int y=y0; y<y1; ++y)
+  {
+    ClipPolygon slab = poly.clipped(1, y, -1).clipped(1, y+1, 1);
+    if(slab.n<3)
+      continue;
+    double xmin = slab.p[0].x(), xmax = xmin;
+    for(int k=1; k<slab.n; ++k)
+    {
+      xmin = std::min(xmin, slab.p[k].x());
+      xmax = std::max(xmax, slab.p[k].x());
+    }
+    int x0 = std::max(clip_ul.x(), int(std::floor(xmin)));
+    int x1 = std::min(clip_lr.x(), int(std::ceil(xmax)));
+    for(int x=x0; x<x1; ++x)
+    {
+      // fraction of the pixel covered by the face
+      double a = slab.clipped(0, x, -1).clipped(0, x+1, 1).area();
+      img(y,x) += value * a;
+    }
+  }
+}
+
+// Implements RIO_PerFaceDensityCoverage. As in rasterize_faces, the faces are binned to square tiles of the image
+// that are processed in parallel. Each pixel is written by a single thread and accumulates the faces in order,
+// thus no per-thread image is needed and the result does not depend on the number of threads.
+template<typename ImageType>
+static void rasterize_image_coverage(const std::vector<Point>& vpositions, const std::vector<Array4i>& faces, const std::vector<double>& values, ImageType& img)
+{
+  const int tile_size = 32;
+  int rows = img.rows();
+  int cols = img.cols();
+  int tiles_x = (cols+tile_size-1)/tile_size;
+  int tiles_y = (rows+tile_size-1)/tile_size;
+  int nf = faces.size();
+
+  // polygons in pixel units and their pixel bounds as [ul,lr)
+  std::vector<ClipPolygon> polygons(nf);
+  std::vector<Array4i> bounds(nf);
+  #pragma omp parallel for
+  for(int f=0; f<nf; ++f)
+  {
+    Array2i ibb_ul, ibb_lr;
+    bounds[f].setZero();
+    if(faces[f](0)<0)
+      continue;
+    Vector2d corners[4];
+    int nb_corners = faces[f](3)<0 ? 3 : 4;
+    for(int k=0; k<nb_corners; ++k)
+      corners[k] = vpositions[faces[f](k)];
+    if(coverage_polygon(corners, nb_corners, rows, cols, polygons[f], ibb_ul, ibb_lr))
+      bounds[f] << ibb_ul, ibb_lr;
+  }
+
+  if(Eigen::nbThreads()==1)
+  {
+    for(int f=0; f<nf; ++f)
+      if((bounds[f].head<2>()<bounds[f].tail<2>()).all())
+        rasterize_face_coverage(polygons[f], values[f], bounds[f].head<2>(), bounds[f].tail<2>(), img);
+    return;
+  }
+
+  // bin the faces
+  std::vector<std::vector<int> > bins(tiles_x*tiles_y);
+  for(int f=0; f<nf; ++f)
+  {
+    if((bounds[f].tail<2>()<=bounds[f].head<2>()).any())
+      continue;
+    Array2i t0 = bounds[f].head<2>()/tile_size;
+    Array2i t1 = (bounds[f].tail<2>()-1)/tile_size;
+    for(int ty=t0.y(); ty<=t1.y(); ++ty)
+      for(int tx=t0.x(); tx<=t1.x(); ++tx)
+        bins[tx+ty*tiles_x].push_back(f);
+  }
+
+  #pragma omp parallel for schedule(dynamic)
+  for(int t=0; t<tiles_x*tiles_y; ++t)
+  {
+    Array2i clip_ul = Array2i(t%tiles_x, t/tiles_x)*tile_size;
+    Array2i clip_lr = (clip_ul+tile_size).min(Array2i(cols,rows));
+    for(int f : bins[t])
+      rasterize_face_coverage(polygons[f], values[f], bounds[f].head<2>().max(clip_ul), bounds[f].tail<2>().min(clip_lr), img);
+  }
+}
+
+// ImageType is either MatrixXd or MatrixXf, the per-pixel values are computed in double precision in both cases.
+// faces holds the corners of each face, the 4th one being -1 for triangles.
+template<typename ImageType>
+static void rasterize_image_impl(const std::vector<Point>& vpositions, const std::vector<Array4i>& faces,
+                                 const VectorXd &density_per_Face, ImageType& img, RasterImageOption opt)
+{
+  int nf = faces.size();
+  std::vector<double> areas(nf);
+  #pragma omp parallel for
+  for(int f=0; f<nf; ++f)
+  {
+    const Array4i& indices = faces[f];
+    if(indices[0]<0)
+      areas[f] = 0;
+    else if(indices[3]<0)
+      areas[f] = std::abs(signed_area(vpositions[indices[0]].head<2>(),
+                                      vpositions[indices[1]].head<2>(),
+                                      vpositions[indices[2]].head<2>() ));
+    else
+      areas[f] = std::abs(signed_area(vpositions[indices[0]].head<2>(),
+                                      vpositions[indices[1]].head<2>(),
+                                      vpositions[indices[2]].head<2>(),
+                                      vpositions[indices[3]].head<2>()
+                                     ));
+  }
 
   float scale = 1./density_per_Face.size();
 
@@ -196,115 +497,92 @@ void rasterize_image(const Surface_mesh &mesh, const VectorXd &density_per_Face,
   int cols = img.cols();
   img.setZero();
 
-  if(opt==RIO_PerFaceDensity)
+  if(opt==RIO_PerFaceDensityCoverage)
   {
-    for(auto f:mesh.faces())
-    {
-      std::array<int,4> indices;
-      int i = 0;
-      for(auto v:mesh.vertices(f))
-        indices[i++] = v.idx();
-      double in_mass = scale*density_per_Face(f.idx());
-      if(i==3)
-      {
-        double area = std::abs(signed_area(vpositions[indices[0]].head<2>(),
-                                           vpositions[indices[1]].head<2>(),
-                                           vpositions[indices[2]].head<2>() ));
-        rasterize_face(rows,cols,
-                       std::array<Vector2d,3>{vpositions[indices[0]].head<2>(),
-                                              vpositions[indices[1]].head<2>(),
-                                              vpositions[indices[2]].head<2>()},
-                       [&] (int x, int y, const Vector2d&) { img(y,x) = in_mass/area; }
-                      );
-      }
-      else if(i==4)
-      {
-        double area = std::abs(signed_area(vpositions[indices[0]].head<2>(),
-                                           vpositions[indices[1]].head<2>(),
-                                           vpositions[indices[2]].head<2>(),
-                                           vpositions[indices[3]].head<2>()
-                                          ));
-        rasterize_face(rows,cols,
-                       std::array<Vector2d,4>{vpositions[indices[0]].head<2>(),
-                                              vpositions[indices[1]].head<2>(),
-                                              vpositions[indices[2]].head<2>(),
-                                              vpositions[indices[3]].head<2>()
-                      },
-                       [&] (int x, int y, const Vector2d&) { img(y,x) = in_mass/area; }
-                      );
-      }
-    }
+    std::vector<double> values(nf);
+    for(int f=0; f<nf; ++f)
+      values[f] = areas[f]>0 ? scale*density_per_Face(f)/areas[f] : 0.;
+    rasterize_image_coverage(vpositions, faces, values, img);
+  }
+  else if(opt==RIO_PerFaceDensity)
+  {
+    rasterize_faces(rows, cols, faces, vpositions,
+                    [&] (int f, int x, int y, const Vector2d&) { img(y,x) = scale*density_per_Face(f)/areas[f]; });
   }
   else // PerVertex
   {
     // first compute per-vertex densities
-    std::vector<Vert> vertices(mesh.n_vertices());
-    for(int i=0; i<mesh.n_vertices(); ++i)
+    int nv = vpositions.size();
+    std::vector<Vert> vertices(nv);
+    for(int i=0; i<nv; ++i)
     {
       vertices[i].p = vpositions[i].head<2>();
       vertices[i].value = 0;
     }
 
-    std::vector<double> divisors(mesh.n_vertices(),0);
-    int i=0, j=0;
-    for(auto f:mesh.faces())
+    std::vector<double> divisors(nv,0);
+    for(int f=0; f<nf; ++f)
     {
-      std::array<int,4> indices;
-      int i = 0;
-      for(auto v:mesh.vertices(f))
-        indices[i++] = v.idx();
-      double area = 0;
-      if(i==3)
-        area = std::abs(signed_area(vpositions[indices[0]].head<2>(), vpositions[indices[1]].head<2>(),vpositions[indices[2]].head<2>() ));
-      else if(i==4)
-        area = std::abs(signed_area(vpositions[indices[0]].head<2>(),
-                                    vpositions[indices[1]].head<2>(),
-                                    vpositions[indices[2]].head<2>(),
-                                    vpositions[indices[3]].head<2>()
-                                   ));
-      for(auto v:mesh.vertices(f))
+      for(int k=0; k<4 && faces[f][k]>=0; ++k)
       {
-        vertices[v.idx()].value += 1./area;
-        divisors[v.idx()] += 1.;
+        vertices[faces[f][k]].value += 1./areas[f];
+        divisors[faces[f][k]] += 1.;
       }
     }
-    for(int i=0; i<mesh.n_vertices(); ++i)
+    for(int i=0; i<nv; ++i)
       vertices[i].value = scale * vertices[i].value / divisors[i];
 
     // then rasterize each face
-    for(auto f:mesh.faces())
-    {
-      std::array<int,4> indices;
-      int i = 0;
-      for(auto v:mesh.vertices(f))
-        indices[i++] = v.idx();
-      if(i==3)
-      {
-        rasterize_face(rows,cols,
-                       std::array<Vert,3>{vertices[indices[0]],
-                                          vertices[indices[1]],
-                                          vertices[indices[2]]},
-                       [&] (int x, int y, const Vert& f) { img(y,x) = f.value; }
-                      );
-      }
-      else if(i==4)
-      {
-        rasterize_face(rows,cols,
-                       std::array<Vert,4>{vertices[indices[0]],
-                                          vertices[indices[1]],
-                                          vertices[indices[2]],
-                                          vertices[indices[3]]},
-                       [&] (int x, int y, const Vert& f) { img(y,x) = f.value; }
-                      );
-      }
-    }
+    rasterize_faces(rows, cols, faces, vertices,
+                    [&] (int, int x, int y, const Vert& f) { img(y,x) = f.value; });
   }
 
 }
 
+template<typename ImageType>
+static void rasterize_image_impl(const Surface_mesh &mesh, const VectorXd &density_per_Face, ImageType& img, RasterImageOption opt)
+{
+  rasterize_image_impl(mesh.get_vertex_property<Point>("v:point").vector(), mesh.face_vertex_indices(), density_per_Face, img, opt);
+}
+
+void rasterize_image(const Surface_mesh &mesh, const VectorXd &density_per_Face, MatrixXd& img, RasterImageOption opt)
+{
+  rasterize_image_impl(mesh, density_per_Face, img, opt);
+}
+
+void rasterize_image(const Surface_mesh &mesh, const VectorXd &density_per_Face, MatrixXf& img, RasterImageOption opt)
+{
+  rasterize_image_impl(mesh, density_per_Face, img, opt);
+}
+
 void rasterize_image(const surface_mesh::Surface_mesh& mesh, MatrixXd& img, RasterImageOption opt)
 {
   rasterize_image(mesh, VectorXd::Ones(mesh.faces_size()), img, opt);
 }
 
+void rasterize_image(const surface_mesh::Surface_mesh& mesh, MatrixXf& img, RasterImageOption opt)
+{
+  rasterize_image(mesh, VectorXd::Ones(mesh.faces_size()), img, opt);
+}
+
+void rasterize_image(const GridMesh& grid, const VectorXd &density_per_Face, MatrixXd& img, RasterImageOption opt)
+{
+  rasterize_image_impl(grid.points(), grid.face_vertices(), density_per_Face, img, opt);
+}
+
+void rasterize_image(const GridMesh& grid, const VectorXd &density_per_Face, MatrixXf& img, RasterImageOption opt)
+{
+  rasterize_image_impl(grid.points(), grid.face_vertices(), density_per_Face, img, opt);
+}
+
+void rasterize_image(const GridMesh& grid, MatrixXd& img, RasterImageOption opt)
+{
+  rasterize_image(grid, VectorXd::Ones(grid.n_faces()), img, opt);
+}
+
+void rasterize_image(const GridMesh& grid, MatrixXf& img, RasterImageOption opt)
+{
+  rasterize_image(grid, VectorXd::Ones(grid.n_faces()), img, opt);
+}
+
 } // namespace otmap
@@ -10,15 +10,29 @@
 
 #include <Eigen/Core>
 #include <surface_mesh/Surface_mesh.h>
+#include "grid_mesh.h"
 
 namespace otmap {
 
 enum RasterImageOption {
   RIO_PerVertexDensity,
-  RIO_PerFaceDensity
+  RIO_PerFaceDensity,
+  // same as RIO_PerFaceDensity, but the faces are exactly integrated over the pixels (conservative rasterization)
+  // instead of being point sampled at the pixel centers, and overlapping faces accumulate their mass
+  RIO_PerFaceDensityCoverage
 };
 
 void rasterize_image(const surface_mesh::Surface_mesh& mesh, const Eigen::VectorXd &density_per_Face, Eigen::MatrixXd& img, RasterImageOption opt = RIO_PerFaceDensity);
 void rasterize_image(const surface_mesh::Surface_mesh& mesh, Eigen::MatrixXd& img, RasterImageOption opt = RIO_PerFaceDensity);
 
+// single precision versions, to be preferred for large output images
+void rasterize_image(const surface_mesh::Surface_mesh& mesh, const Eigen::VectorXd &density_per_Face, Eigen::MatrixXf& img, RasterImageOption opt = RIO_PerFaceDensity);
+void rasterize_image(const surface_mesh::Surface_mesh& mesh, Eigen::MatrixXf& img, RasterImageOption opt = RIO_PerFaceDensity);
+
+// grid versions, the faces are directly enumerated from the implicit grid connectivity
+void rasterize_image(const GridMesh& grid, const Eigen::VectorXd &density_per_Face, Eigen::MatrixXd& img, RasterImageOption opt = RIO_PerFaceDensity);
+void rasterize_image(const GridMesh& grid, Eigen::MatrixXd& img, RasterImageOption opt = RIO_PerFaceDensity);
+void rasterize_image(const GridMesh& grid, const Eigen::VectorXd &density_per_Face, Eigen::MatrixXf& img, RasterImageOption opt = RIO_PerFaceDensity);
+void rasterize_image(const GridMesh& grid, Eigen::MatrixXf& img, RasterImageOption opt = RIO_PerFaceDensity);
+
 } // namespace otmap
@@ -8,15 +8,37 @@
 
 #include "stochastic_rasterizer.h"
 #include <vector>
+#include <cstdint>
 #include <Eigen/Core>
 #include <surface_mesh/Surface_mesh.h>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 using namespace surface_mesh;
 using namespace Eigen;
 
 namespace otmap {
 
-void sample_transportmap_to_image(const Surface_mesh &mesh, const VectorXi &sample_per_face, MatrixXd& img)
+// Counter-based random numbers: the value only depends on the pair (key,counter),
+// so that the samples of a face do not depend on the order in which the faces are processed.
+static inline uint64_t mix64(uint64_t z)
+{
+  // splitmix64 finalizer
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static inline double random_unit(uint64_t key, uint64_t counter)
+{
+  return double(mix64(mix64(key) + counter) >> 11) * (1./9007199254740992.);
+}
+
+// face_corners(i,v) must copy the 3 or 4 corners of the face i into v and return their number
+template<typename ImageType, typename FaceCorners>
+static void sample_transportmap_to_image_impl(int nf, FaceCorners face_corners, const VectorXi &sample_per_face, ImageType& img)
 {
   int rows = img.rows();
   int cols = img.cols();
@@ -25,55 +47,64 @@ void sample_transportmap_to_image(const Surface_mesh &mesh, const VectorXi &samp
 
   img.setZero();
 
-  std::vector<Vector3d> samples;
+  // The samples of each face follow the 2D low-discrepancy R2 sequence (Roberts 2018),
+  // randomly shifted per face (Cranley-Patterson rotation).
+  const double g = 1.32471795724474602596;
+  const Vector2d alpha(1./g, 1./(g*g));
+
+  // Each thread accumulates its own image, as the counts are integers the result does not depend on the number of threads.
+  int nb_threads = Eigen::nbThreads();
+  std::vector<ImageType> buffers(nb_threads-1, ImageType::Zero(rows, cols));
 
-  int nf = mesh.faces_size();
+  #pragma omp parallel for schedule(dynamic,256) num_threads(nb_threads)
   for(int i=0; i<nf; ++i){
     int ns = sample_per_face(i);
     if(ns>0) {
-      Surface_mesh::Face f(i);
+      int thread_id = 0;
+#ifdef _OPENMP
+      thread_id = omp_get_thread_num();
+#endif
+      ImageType& buffer = thread_id==0 ? img : buffers[thread_id-1];
 
-      Surface_mesh::Vertex indices[4];
-      int nv = 0;
-      for(auto v:mesh.vertices(f))
-        indices[nv++] = v;
+      Vector2d corners[4];
+      int nv = face_corners(i, corners);
+      if(nv==0) // deleted face
+        continue;
 
-      Vector2d v1 = mesh.position( indices[0] );
-      Vector2d v2 = mesh.position( indices[1] );
-      Vector2d v3 = mesh.position( indices[2] );
-      Vector2d v4;
-      if(nv==4)
-        v4 = mesh.position( indices[3] );
+      const Vector2d& v1 = corners[0];
+      const Vector2d& v2 = corners[1];
+      const Vector2d& v3 = corners[2];
+      const Vector2d& v4 = corners[3];
 
       assert(nv==3 || nv==4);
 
-      samples.resize(ns);
-      if(nv==3)
-        for(int j=0; j<ns; ++j) {
-          double r1 = std::sqrt(internal::random<double>(0.,1.));
-          double r2 = internal::random<double>(0.,1.);
-          samples[j] << 1. - r1, r1*(1.-r2), r1*r2;
-        }
-      else
-      {
-        for(int j=0; j<ns; ++j)
-          samples[j] = Vector3d::Random().cwiseAbs();
-      }
+      Vector2d shift(random_unit(i,0), random_unit(i,1));
+
       for(int j = 0; j<ns; ++j)
       {
+        Vector2d s = shift + double(j)*alpha;
+        s = s.array() - s.array().floor();
+
         //compute position
         Eigen::Vector2d p;
         if(nv==3)
-          p = samples[j](0)*v1 + samples[j](1)*v2 + samples[j](2)*v3;
+        {
+          double r1 = std::sqrt(s(0));
+          double r2 = s(1);
+          p = (1. - r1)*v1 + r1*(1.-r2)*v2 + r1*r2*v3;
+        }
         else
         {
-          double u = samples[j](0);
-          double v = samples[j](1);
+          double u = s(0);
+          double v = s(1);
           p = (1.-u)*(1-v)*v1 + (u)*(1-v)*v2 + (u)*(v)*v3 + (1.-u)*(v)*v4;
         }
         if(p.x()<0 || p.y()<0 || p.x()>1 || p.y()>1 || !p.array().isFinite().all()) {
           if(!p.array().isFinite().all())
-            std::cout << samples[j].transpose().head<2>() << "   ;   " << p.transpose() << " " << v1.transpose() << " " << v2.transpose() << " " << v3.transpose() << " " << v4.transpose() << " " << "\n";
+          {
+            #pragma omp critical
+            std::cout << s.transpose() << "   ;   " << p.transpose() << " " << v1.transpose() << " " << v2.transpose() << " " << v3.transpose() << " " << v4.transpose() << " " << "\n";
+          }
           continue;
         }
         //compute the pixel
@@ -81,10 +112,49 @@ void sample_transportmap_to_image(const Surface_mesh &mesh, const VectorXi &samp
         int pj = int(p.x()/dx);
 
         if(pi < rows && pj<cols)
-          img(pi,pj) += 1.;
+          buffer(pi,pj) += 1.;
       }
     }
   }
+
+  for(const ImageType& buffer : buffers)
+    img += buffer;
+}
+
+template<typename ImageType>
+static void sample_transportmap_to_image_impl(const Surface_mesh &mesh, const VectorXi &sample_per_face, ImageType& img)
+{
+  const std::vector<Array4i>& face_vertices = mesh.face_vertex_indices();
+  auto face_corners = [&] (int i, Vector2d* corners) {
+    const Array4i& fv = face_vertices[i];
+    int nv = fv[0]<0 ? 0 : fv[3]<0 ? 3 : 4;
+    for(int k=0; k<nv; ++k)
+      corners[k] = mesh.position(Surface_mesh::Vertex(fv[k]));
+    return nv;
+  };
+  sample_transportmap_to_image_impl(mesh.faces_size(), face_corners, sample_per_face, img);
+}
+
+template<typename ImageType>
+static void sample_transportmap_to_image_impl(const GridMesh &grid, const VectorXi &sample_per_face, ImageType& img)
+{
+  auto face_corners = [&grid] (int i, Vector2d* corners) {
+    Array4i fv = grid.face_vertices(i);
+    for(int k=0; k<4; ++k)
+      corners[k] = grid.position(fv[k]);
+    return 4;
+  };
+  sample_transportmap_to_image_impl(grid.n_faces(), face_corners, sample_per_face, img);
+}
+
+void sample_transportmap_to_image(const Surface_mesh &mesh, const VectorXi &sample_per_face, MatrixXd& img)
+{
+  sample_transportmap_to_image_impl(mesh, sample_per_face, img);
+}
+
+void sample_transportmap_to_image(const Surface_mesh &mesh, const VectorXi &sample_per_face, MatrixXf& img)
+{
+  sample_transportmap_to_image_impl(mesh, sample_per_face, img);
 }
 
 void sample_transportmap_to_image(const surface_mesh::Surface_mesh& mesh, Eigen::MatrixXd& img, int sample_per_face)
@@ -92,4 +162,29 @@ void sample_transportmap_to_image(const surface_mesh::Surface_mesh& mesh, Eigen:
   sample_transportmap_to_image(mesh, Eigen::VectorXi::Constant(mesh.faces_size(), sample_per_face), img);
 }
 
+void sample_transportmap_to_image(const surface_mesh::Surface_mesh& mesh, Eigen::MatrixXf& img, int sample_per_face)
+{
+  sample_transportmap_to_image(mesh, Eigen::VectorXi::Constant(mesh.faces_size(), sample_per_face), img);
+}
+
+void sample_transportmap_to_image(const GridMesh &grid, const VectorXi &sample_per_face, MatrixXd& img)
+{
+  sample_transportmap_to_image_impl(grid, sample_per_face, img);
+}
+
+void sample_transportmap_to_image(const GridMesh &grid, const VectorXi &sample_per_face, MatrixXf& img)
+{
+  sample_transportmap_to_image_impl(grid, sample_per_face, img);
+}
+
+void sample_transportmap_to_image(const GridMesh& grid, Eigen::MatrixXd& img, int sample_per_face)
+{
+  sample_transportmap_to_image(grid, Eigen::VectorXi::Constant(grid.n_faces(), sample_per_face), img);
+}
+
+void sample_transportmap_to_image(const GridMesh& grid, Eigen::MatrixXf& img, int sample_per_face)
+{
+  sample_transportmap_to_image(grid, Eigen::VectorXi::Constant(grid.n_faces(), sample_per_face), img);
+}
+
 } // namespace otmap
@@ -18,4 +18,15 @@ void sample_transportmap_to_image(const surface_mesh::Surface_mesh& mesh, const
 
 void sample_transportmap_to_image(const surface_mesh::Surface_mesh& mesh, Eigen::MatrixXd& img, int sample_per_face = 100);
 
+// single precision versions, the sample counts remain exact as long as they are lower than 2^24 per pixel
+void sample_transportmap_to_image(const surface_mesh::Surface_mesh& mesh, const Eigen::VectorXi &sample_per_face, Eigen::MatrixXf& img);
+
+void sample_transportmap_to_image(const surface_mesh::Surface_mesh& mesh, Eigen::MatrixXf& img, int sample_per_face = 100);
+
+// grid versions, the corners of the faces are directly fetched from the implicit grid connectivity
+void sample_transportmap_to_image(const GridMesh& grid, const Eigen::VectorXi &sample_per_face, Eigen::MatrixXd& img);
+void sample_transportmap_to_image(const GridMesh& grid, Eigen::MatrixXd& img, int sample_per_face = 100);
+void sample_transportmap_to_image(const GridMesh& grid, const Eigen::VectorXi &sample_per_face, Eigen::MatrixXf& img);
+void sample_transportmap_to_image(const GridMesh& grid, Eigen::MatrixXf& img, int sample_per_face = 100);
+
 } // namespace otmap
@@ -0,0 +1,95 @@
+// This file is part of otmap, an optimal transport solver.
+//
+// Copyright (C) 2017-2018 Gael Guennebaud <gael.guennebaud@inria.fr>
+//
+// This Source Code Form is subject to the terms of the Mozilla
+// Public License v. 2.0. If a copy of the MPL was not distributed
+// with this file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <cstdlib>
+
+#include <surface_mesh/Surface_mesh.h>
+
+using namespace surface_mesh;
+
+static int nb_failures = 0;
+
+#define CHECK(COND) if(!(COND)) { std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #COND "\n"; ++nb_failures; }
+
+// a single quad with a custom property per element type, set to 3
+static Surface_mesh make_mesh()
+{
+  Surface_mesh mesh;
+  Surface_mesh::Vertex v0 = mesh.add_vertex(Point(0,0));
+  Surface_mesh::Vertex v1 = mesh.add_vertex(Point(1,0));
+  Surface_mesh::Vertex v2 = mesh.add_vertex(Point(1,1));
+  Surface_mesh::Vertex v3 = mesh.add_vertex(Point(0,1));
+  mesh.add_quad(v0, v1, v2, v3);
+  mesh.add_vertex_property<int>("v:foo", 3);
+  mesh.add_halfedge_property<int>("h:foo", 3);
+  mesh.add_edge_property<int>("e:foo", 3);
+  mesh.add_face_property<int>("f:foo", 3);
+  return mesh;
+}
+
+int main()
+{
+  const Surface_mesh::Vertex v(0);
+  const Surface_mesh::Halfedge h(0);
+  const Surface_mesh::Edge e(0);
+  const Surface_mesh::Face f(0);
+
+  // writing to a copy must not modify the source mesh
+  {
+    Surface_mesh a = make_mesh();
+    Surface_mesh d = a;
+    d.get_vertex_property<int>("v:foo")[v] = 42;
+    d.get_halfedge_property<int>("h:foo")[h] = 42;
+    d.get_edge_property<int>("e:foo")[e] = 42;
+    d.get_face_property<int>("f:foo")[f] = 42;
+    d.position(v) = Point(-1,-1);
+
+    const Surface_mesh& ca = a;
+    CHECK(ca.get_vertex_property<int>("v:foo")[v] == 3);
+    CHECK(ca.get_halfedge_property<int>("h:foo")[h] == 3);
+    CHECK(ca.get_edge_property<int>("e:foo")[e] == 3);
+    CHECK(ca.get_face_property<int>("f:foo")[f] == 3);
+    CHECK(ca.position(v) == Point(0,0));
+
+    const Surface_mesh& cd = d;
+    CHECK(cd.get_face_property<int>("f:foo")[f] == 42);
+    CHECK(cd.position(v) == Point(-1,-1));
+  }
+
+  // writing to the source through a handle fetched again after the copy must not modify the copy
+  {
+    Surface_mesh a = make_mesh();
+    Surface_mesh::Face_property<int> old_handle = a.get_face_property<int>("f:foo");
+    Surface_mesh b = a;
+    a.get_face_property<int>("f:foo")[f] = 42;
+
+    const Surface_mesh& cb = b;
+    CHECK(cb.get_face_property<int>("f:foo")[f] == 3);
+    CHECK(old_handle[f] == 3);
+    CHECK(a.get_face_property<int>("f:foo")[f] == 42);
+  }
+
+  // modifying the connectivity of a copy must not modify the source mesh
+  {
+    Surface_mesh a = make_mesh();
+    Surface_mesh d = a;
+    d.delete_face(f);
+    d.garbage_collection();
+    CHECK(d.n_faces() == 0);
+    CHECK(a.n_faces() == 1);
+    CHECK(a.valence(v) == 2);
+  }
+
+  if(nb_failures>0)
+  {
+    std::cerr << nb_failures << " check(s) failed\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}